@@ -0,0 +1,50 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+/**
+ * @brief Global operator new/delete replacements that count heap use
+ * @details Every heap allocation in the process, to show which runs stay
+ *          off it. Not thread safe, read the counters around single
+ *          threaded work. The replacements are definitions, so include
+ *          this from the program's main file only.
+ *
+ *          auto before = heap_allocations;
+ *          run_workload();
+ *          std::cout << heap_allocations - before << " allocations\n";
+ */
+
+/* Allocations and bytes asked for so far */
+static std::size_t heap_allocations = 0;
+static std::size_t heap_bytes = 0;
+
+void * operator new(std::size_t n)
+{
+    ++heap_allocations;
+    heap_bytes += n;
+    if (void * p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc{};
+}
+
+void * operator new(std::size_t n, std::align_val_t al)
+{
+    ++heap_allocations;
+    heap_bytes += n;
+    auto const a = static_cast<std::size_t>(al);
+    /* aligned_alloc wants a multiple of the alignment */
+    if (void * p = std::aligned_alloc(a, (n + a - 1) & ~(a - 1)))
+        return p;
+    throw std::bad_alloc{};
+}
+
+/* Out of line, or gcc sees free() against an inlined new and warns */
+__attribute__((noinline)) void operator delete(void * p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void * p, std::size_t) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void * p, std::align_val_t) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void * p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+#endif  // ALLOC_COUNTER_H
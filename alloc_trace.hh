@@ -0,0 +1,261 @@
+#ifndef ALLOC_TRACE_H
+#define ALLOC_TRACE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Allocation trace recording and reading
+ * @details Containers record their traffic by using tracing_allocator
+ *          instead of their normal allocator, no LD_PRELOAD needed:
+ *
+ *          alloc_trace_recorder rec;
+ *          tracing_allocator<int> a{rec};
+ *          std::vector<int, tracing_allocator<int>> v{a};
+ *          ...
+ *          std::ofstream out{"app.trace", std::ios::binary};
+ *          rec.write(out);
+ *
+ *          Trace format: the 8 byte magic "ALTRACE1" followed by events.
+ *          Each event is a kind byte (0 alloc, 1 free) then LEB128 fields:
+ *          object id, size in bytes (alloc only), thread number and
+ *          nanoseconds since the previous event. Object ids are dense and
+ *          assigned in allocation order so a replay can index by them.
+ */
+
+/* One decoded trace event */
+struct alloc_trace_event
+{
+    enum kind_type : std::uint8_t { alloc = 0, free = 1 };
+
+    kind_type kind;
+    /* Dense object id, shared by an alloc and its free */
+    std::uint64_t id;
+    /* Requested bytes */
+    std::uint64_t size;
+    /* Recording thread, numbered from 0 in order of first use */
+    std::uint32_t thread;
+    /* Nanoseconds since the start of the recording */
+    std::uint64_t timestamp_ns;
+};
+
+class alloc_trace_recorder
+{
+private:
+    using clock = std::chrono::steady_clock;
+
+    /* Guards everything below, containers on several threads may share us */
+    mutable std::mutex m_mutex;
+    /* Encoded events */
+    std::vector<unsigned char> m_data;
+    /* Live pointer -> object id */
+    std::unordered_map<void const *, std::uint64_t> m_live;
+    /* std::thread::id -> small thread number */
+    std::unordered_map<std::thread::id, std::uint32_t> m_threads;
+    std::uint64_t m_next_id;
+    std::uint64_t m_events;
+    clock::time_point m_last;
+
+    void put_varint(std::uint64_t v)
+    {
+        while (v >= 0x80) {
+            m_data.push_back(static_cast<unsigned char>(v | 0x80));
+            v >>= 7;
+        }
+        m_data.push_back(static_cast<unsigned char>(v));
+    }
+
+    /* Thread number and time delta, caller holds m_mutex */
+    void put_common()
+    {
+        auto tid = std::this_thread::get_id();
+        auto found = m_threads.find(tid);
+        if (found == m_threads.end())
+            found = m_threads.emplace(tid, static_cast<std::uint32_t>(m_threads.size())).first;
+
+        auto now = clock::now();
+        put_varint(found->second);
+        put_varint(static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_last).count()));
+        m_last = now;
+        ++m_events;
+    }
+
+public:
+    alloc_trace_recorder() :
+        m_next_id{0},
+        m_events{0},
+        m_last{clock::now()}
+    {
+        m_data.reserve(1 << 16);
+    }
+
+    alloc_trace_recorder(alloc_trace_recorder const &) = delete;
+    alloc_trace_recorder& operator=(alloc_trace_recorder const &) = delete;
+
+    void on_allocate(void const * p, std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> lk{m_mutex};
+
+        auto id = m_next_id++;
+        m_live[p] = id;
+
+        m_data.push_back(alloc_trace_event::alloc);
+        put_varint(id);
+        put_varint(bytes);
+        put_common();
+    }
+
+    void on_deallocate(void const * p, std::size_t)
+    {
+        std::lock_guard<std::mutex> lk{m_mutex};
+
+        /* Not ours, nothing to pair it with */
+        auto found = m_live.find(p);
+        if (found == m_live.end())
+            return;
+
+        m_data.push_back(alloc_trace_event::free);
+        put_varint(found->second);
+        put_common();
+        m_live.erase(found);
+    }
+
+    std::uint64_t events() const
+    {
+        std::lock_guard<std::mutex> lk{m_mutex};
+        return m_events;
+    }
+
+    void write(std::ostream & os) const
+    {
+        std::lock_guard<std::mutex> lk{m_mutex};
+        os.write("ALTRACE1", 8);
+        os.write(reinterpret_cast<char const *>(m_data.data()),
+                 static_cast<std::streamsize>(m_data.size()));
+    }
+};
+
+/**
+ * @brief Decodes a whole trace
+ * @throws std::runtime_error on a bad magic or a truncated event
+ */
+inline std::vector<alloc_trace_event> read_alloc_trace(std::istream & is)
+{
+    char magic[8];
+    if (!is.read(magic, 8) || std::string(magic, 8) != "ALTRACE1")
+        throw std::runtime_error("Not an allocation trace");
+
+    std::vector<unsigned char> data{std::istreambuf_iterator<char>{is},
+                                    std::istreambuf_iterator<char>{}};
+    std::vector<alloc_trace_event> ret;
+    std::size_t pos = 0;
+    std::uint64_t now = 0;
+
+    auto get_varint = [&]() -> std::uint64_t {
+        std::uint64_t v = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7)
+        {
+            if (pos == data.size())
+                throw std::runtime_error("Truncated allocation trace");
+            auto b = data[pos++];
+            v |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return v;
+        }
+        throw std::runtime_error("Bad varint in allocation trace");
+    };
+
+    while (pos < data.size())
+    {
+        alloc_trace_event e{};
+        auto kind = data[pos++];
+
+        if (kind != alloc_trace_event::alloc && kind != alloc_trace_event::free)
+            throw std::runtime_error("Bad event in allocation trace");
+
+        e.kind = static_cast<alloc_trace_event::kind_type>(kind);
+        e.id = get_varint();
+        e.size = e.kind == alloc_trace_event::alloc ? get_varint() : 0;
+        e.thread = static_cast<std::uint32_t>(get_varint());
+        now += get_varint();
+        e.timestamp_ns = now;
+
+        ret.push_back(e);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Allocator adapter that records to an alloc_trace_recorder
+ * @tparam T Value type
+ * @tparam Inner Allocator doing the actual work
+ */
+template<typename T, typename Inner = std::allocator<T>>
+class tracing_allocator
+{
+public:
+    using value_type = T;
+    using inner_type = Inner;
+
+private:
+    alloc_trace_recorder * m_rec;
+    inner_type m_inner;
+
+public:
+    template <class _Up>
+        struct rebind {
+            using other = tracing_allocator<_Up,
+                  typename std::allocator_traits<Inner>::template rebind_alloc<_Up>>;
+        };
+
+    explicit tracing_allocator(alloc_trace_recorder & rec, inner_type inner = inner_type{}) :
+        m_rec(&rec),
+        m_inner(std::move(inner))
+    {}
+
+    template<typename U, typename I>
+        tracing_allocator(tracing_allocator<U, I> const & other) :
+            m_rec(other.m_rec),
+            m_inner(other.m_inner)
+        {}
+
+    T * allocate(std::size_t num)
+    {
+        auto * p = std::allocator_traits<Inner>::allocate(m_inner, num);
+        m_rec->on_allocate(p, num * sizeof(T));
+        return p;
+    }
+
+    void deallocate(T * p, std::size_t num)
+    {
+        m_rec->on_deallocate(p, num * sizeof(T));
+        std::allocator_traits<Inner>::deallocate(m_inner, p, num);
+    }
+
+    template<typename U, typename I>
+        bool operator==(tracing_allocator<U, I> const & other) const {
+            return m_rec == other.m_rec && m_inner == other.m_inner;
+        }
+
+    template<typename U, typename I>
+        bool operator!=(tracing_allocator<U, I> const & other) const {
+            return !(*this == other);
+        }
+
+    template<typename U, typename I> friend class tracing_allocator;
+};
+
+#endif  // ALLOC_TRACE_H
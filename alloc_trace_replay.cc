@@ -0,0 +1,315 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <malloc.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "alloc_trace.hh"
+#include "bench.hh"
+#include "linear_object_storage.hh"
+#include "short_alloc.hh"
+
+/**
+ * Records or replays allocation traces.
+ *
+ *   alloc_trace_replay record out.trace    - traces a sample container workload
+ *   alloc_trace_replay [bench opts] in.trace - replays in.trace against each allocator
+ *
+ * Replays run single threaded in recorded order, as fast as possible. Each
+ * allocator gets its own forked process so peak RSS is its own.
+ */
+
+/* Slot size used when replaying against linear_object_storage */
+struct slot { alignas(std::max_align_t) unsigned char data[64]; };
+constexpr std::size_t los_slots = 1 << 18;
+constexpr std::size_t arena_bytes = 64 << 20;
+
+using los_type = linear_object_storage<slot, los_slots>;
+using arena_type = arena<arena_bytes>;
+
+/* What a child sends back */
+struct replay_stats
+{
+    double median_ns;
+    double p99_ns;
+    double min_ns;
+    /* Peak RSS growth over the child's starting RSS */
+    long peak_rss_kb;
+    /* 1 - peak live bytes / peak footprint bytes */
+    double fragmentation;
+    /* Allocations the allocator refused */
+    std::size_t failures;
+};
+
+/* Bytes the process heap has taken from the OS */
+std::size_t heap_footprint()
+{
+    auto mi = ::mallinfo2();
+    return mi.arena + mi.hblkhd;
+}
+
+long current_rss_kb()
+{
+    std::ifstream statm{"/proc/self/statm"};
+    long pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * (::sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * @brief Replays the trace with alloc(bytes) -> void * / dealloc(p, bytes)
+ * @param footprint Bytes the allocator is holding right now
+ */
+template<typename Alloc, typename Dealloc, typename Footprint, typename Reset>
+replay_stats replay(std::vector<alloc_trace_event> const & events, bench::options const & opts,
+                    Alloc alloc, Dealloc dealloc, Footprint footprint, Reset reset)
+{
+    replay_stats ret{};
+    auto start_rss = current_rss_kb();
+
+    std::uint64_t max_id = 0;
+    for (auto const & e : events)
+        max_id = std::max(max_id, e.id);
+
+    std::vector<void *> live(max_id + 1, nullptr);
+    std::vector<std::uint64_t> sizes(max_id + 1, 0);
+
+    /* Objects the trace never frees go before the next run */
+    auto free_leftovers = [&] {
+        for (std::size_t i = 0; i < live.size(); ++i)
+            if (live[i]) {
+                dealloc(live[i], sizes[i]);
+                live[i] = nullptr;
+            }
+        reset();
+    };
+
+    auto step = [&](alloc_trace_event const & e) {
+        if (e.kind == alloc_trace_event::alloc) {
+            try {
+                live[e.id] = alloc(e.size);
+                sizes[e.id] = e.size;
+            }
+            catch (std::bad_alloc const &) {
+                ++ret.failures;
+            }
+        }
+        else if (live[e.id]) {
+            dealloc(live[e.id], sizes[e.id]);
+            live[e.id] = nullptr;
+        }
+    };
+
+    /* Untimed pass sampling live bytes against footprint, first so
+     * nothing has grown yet */
+    std::size_t live_bytes = 0, peak_live = 0, base = footprint(), peak_footprint = 0;
+    for (std::size_t i = 0; i < events.size(); ++i)
+    {
+        auto const & e = events[i];
+        if (e.kind != alloc_trace_event::alloc && live[e.id])
+            live_bytes -= sizes[e.id];
+
+        step(e);
+
+        /* Refused allocations never count as live */
+        if (e.kind == alloc_trace_event::alloc && live[e.id])
+            live_bytes += e.size;
+
+        peak_live = std::max(peak_live, live_bytes);
+        if (i % 64 == 0)
+            peak_footprint = std::max(peak_footprint, footprint() - std::min(base, footprint()));
+    }
+    peak_footprint = std::max(peak_footprint, footprint() - std::min(base, footprint()));
+
+    ret.fragmentation = peak_footprint ?
+        1.0 - static_cast<double>(peak_live) / static_cast<double>(peak_footprint) : 0.0;
+
+    /* One pass worth of refusals */
+    auto failures = ret.failures;
+
+    auto result = bench::run("replay", {}, opts, events.size(), free_leftovers, [&] {
+        for (auto const & e : events)
+            step(e);
+    });
+
+    ret.median_ns = result.median_ns;
+    ret.p99_ns = result.p99_ns;
+    ret.min_ns = result.min_ns;
+    ret.failures = failures;
+
+    rusage ru;
+    ::getrusage(RUSAGE_SELF, &ru);
+    ret.peak_rss_kb = ru.ru_maxrss - start_rss;
+
+    free_leftovers();
+
+    return ret;
+}
+
+/* Runs fn() in a child process and hands back what it returned */
+template<typename F>
+bool in_child(F fn, replay_stats & out)
+{
+    int fds[2];
+    if (::pipe(fds) != 0)
+        return false;
+
+    auto pid = ::fork();
+    if (pid == 0)
+    {
+        ::close(fds[0]);
+        auto stats = fn();
+        auto ok = ::write(fds[1], &stats, sizeof(stats)) == sizeof(stats);
+        ::_exit(ok ? 0 : 1);
+    }
+
+    ::close(fds[1]);
+    auto got = ::read(fds[0], &out, sizeof(out));
+    ::close(fds[0]);
+
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+
+    return pid > 0 && got == sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/* Sample workload: a few threads churning maps, vectors, lists and strings */
+void record(std::string const & path)
+{
+    alloc_trace_recorder rec;
+
+    auto work = [&rec](unsigned seed) {
+        using str = std::basic_string<char, std::char_traits<char>, tracing_allocator<char>>;
+        using map = std::map<int, str, std::less<int>, tracing_allocator<std::pair<int const, str>>>;
+
+        std::mt19937 g{seed};
+        tracing_allocator<char> a{rec};
+        map m{a};
+        std::vector<int, tracing_allocator<int>> v{a};
+        std::list<str, tracing_allocator<str>> l{a};
+
+        for (int i = 0; i < 20000; ++i)
+        {
+            auto k = static_cast<int>(g() % 2000);
+            switch (g() % 4)
+            {
+            case 0: m.emplace(k, str(16 + g() % 200, 'x', a)); break;
+            case 1: m.erase(k); break;
+            case 2: v.push_back(k); if (v.size() > 5000) v = decltype(v){a}; break;
+            case 3: l.emplace_back(8 + g() % 64, 'y', a); if (l.size() > 300) l.pop_front(); break;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < 4; ++t)
+        threads.emplace_back(work, t + 1);
+    for (auto & t : threads)
+        t.join();
+
+    std::ofstream out{path, std::ios::binary};
+    rec.write(out);
+    std::cout << "recorded " << rec.events() << " events to " << path << std::endl;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc == 3 && std::string{argv[1]} == "record") {
+        record(argv[2]);
+        return 0;
+    }
+
+    auto opts = bench::parse_args(argc, argv);
+    std::string path;
+    for (int i = 1; i < argc; ++i)
+        if (std::strncmp(argv[i], "--", 2) != 0)
+            path = argv[i];
+
+    if (path.empty()) {
+        std::cerr << "usage: " << argv[0] << " record out.trace\n"
+                  << "       " << argv[0] << " [--format=text|csv|json] [--runs=N] in.trace\n";
+        return 1;
+    }
+
+    std::ifstream in{path, std::ios::binary};
+    auto events = read_alloc_trace(in);
+    bench::reporter rep{opts};
+
+    auto add = [&](std::string const & name, replay_stats const & s) {
+        bench::result r;
+        r.name = name;
+        r.ops = events.size();
+        r.median_ns = s.median_ns;
+        r.p99_ns = s.p99_ns;
+        r.min_ns = s.min_ns;
+        r.params = {
+            {"mops_per_s", std::to_string(events.size() / s.median_ns * 1000.0)},
+            {"peak_rss_kb", std::to_string(s.peak_rss_kb)},
+            {"fragmentation", std::to_string(s.fragmentation)},
+            {"failures", std::to_string(s.failures)},
+        };
+        rep.add(std::move(r));
+    };
+
+    replay_stats stats;
+
+    if (rep.wanted("linear_object_storage") && in_child([&] {
+            auto los = std::unique_ptr<los_type>{new los_type{}};
+            auto slots = [](std::size_t bytes) { return (bytes + sizeof(slot) - 1) / sizeof(slot); };
+            return replay(events, opts,
+                [&](std::size_t bytes) -> void * { return los->allocate(slots(bytes)); },
+                [&](void * p, std::size_t bytes) { los->deallocate(static_cast<slot *>(p), slots(bytes)); },
+                [&] { return los->get_info().second * sizeof(slot); },
+                [] {});
+        }, stats))
+        add("linear_object_storage", stats);
+
+    if (rep.wanted("short_alloc") && in_child([&] {
+            auto ar = std::unique_ptr<arena_type>{new arena_type{}};
+            std::size_t peak_used = 0;
+            auto heap_base = heap_footprint();
+            return replay(events, opts,
+                [&](std::size_t bytes) -> void * {
+                    auto * p = ar->allocate<alignof(std::max_align_t)>(bytes);
+                    peak_used = std::max(peak_used, ar->used());
+                    return p;
+                },
+                [&](void * p, std::size_t bytes) { ar->deallocate(static_cast<char *>(p), bytes); },
+                /* The bump high-water mark plus whatever fell back to the heap */
+                [&] { return peak_used + heap_footprint() - std::min(heap_base, heap_footprint()); },
+                [&] { ar->reset(); peak_used = 0; });
+        }, stats))
+        add("short_alloc", stats);
+
+    if (rep.wanted("malloc") && in_child([&] {
+            return replay(events, opts,
+                [](std::size_t bytes) { return std::malloc(bytes); },
+                [](void * p, std::size_t) { std::free(p); },
+                heap_footprint,
+                [] {});
+        }, stats))
+        add("malloc", stats);
+
+    if (rep.wanted("new") && in_child([&] {
+            return replay(events, opts,
+                [](std::size_t bytes) { return ::operator new(bytes); },
+                [](void * p, std::size_t) { ::operator delete(p); },
+                heap_footprint,
+                [] {});
+        }, stats))
+        add("new", stats);
+
+    rep.print(std::cout);
+}
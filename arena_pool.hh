@@ -0,0 +1,107 @@
+#ifndef ARENA_POOL_H
+#define ARENA_POOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "short_alloc.hh"
+
+// Per-thread cache of arenas for request-scoped allocation.
+//
+// Each request takes a lease on a freshly reset arena and hands it back when
+// the lease goes away, so the buffer (and with mmap_arena, its page tables)
+// is reused from one request to the next instead of being rebuilt. Arenas
+// never move between threads; a lease must be released on the thread that
+// acquired it. Cached arenas are keyed on the constructor arguments they
+// were built with, so acquire(1 << 20) never hands back a 64 KiB mmap_arena.
+//
+//   using pool = thread_arena_pool<arena<256 * 1024>>;
+//   auto lease = pool::acquire();
+//   std::vector<int, short_alloc<int, 256 * 1024>> v{*lease};
+template <class Arena, std::size_t MaxCached = 4>
+class thread_arena_pool
+{
+    // One cache per argument type list, searched by value
+    template <class Key>
+    using cache_type = std::vector<std::pair<Key, std::unique_ptr<Arena>>>;
+
+    template <class Key>
+    static cache_type<Key>& cache()
+    {
+        static thread_local cache_type<Key> c;
+        return c;
+    }
+
+public:
+    template <class Key>
+    class basic_lease
+    {
+        Key key_;
+        std::unique_ptr<Arena> a_;
+
+        friend class thread_arena_pool;
+        basic_lease(Key key, std::unique_ptr<Arena> a) noexcept
+            : key_(std::move(key)), a_(std::move(a)) {}
+
+    public:
+        basic_lease(basic_lease&&) noexcept = default;
+        basic_lease& operator=(basic_lease&&) = delete;
+
+        ~basic_lease()
+        {
+            if (!a_)
+                return;
+            a_->reset();
+            auto& c = cache<Key>();
+            if (c.size() < MaxCached)
+                c.emplace_back(std::move(key_), std::move(a_));
+        }
+
+        Arena& operator*() const noexcept {return *a_;}
+        Arena* operator->() const noexcept {return a_.get();}
+        Arena* get() const noexcept {return a_.get();}
+    };
+
+    // What acquire() with no arguments returns
+    using lease = basic_lease<std::tuple<>>;
+
+    // A reset arena from this thread's cache that was built from the same
+    // args, or a new one built from args when there is none
+    template <class... Args>
+    static basic_lease<std::tuple<std::decay_t<Args>...>> acquire(Args&&... args)
+    {
+        using key_type = std::tuple<std::decay_t<Args>...>;
+        key_type key{args...};
+
+        auto& c = cache<key_type>();
+        for (auto it = c.rbegin(); it != c.rend(); ++it) {
+            if (it->first != key)
+                continue;
+            auto a = std::move(it->second);
+            c.erase(std::next(it).base());
+            a->reset_stats();
+            return {std::move(key), std::move(a)};
+        }
+
+        return {std::move(key), std::unique_ptr<Arena>{new Arena(std::forward<Args>(args)...)}};
+    }
+
+    // Arenas this thread is holding on to for acquire(args...)
+    template <class... Args>
+    static std::size_t cached(const Args&... args)
+    {
+        using key_type = std::tuple<std::decay_t<Args>...>;
+        key_type key{args...};
+        auto& c = cache<key_type>();
+        return static_cast<std::size_t>(std::count_if(c.begin(), c.end(),
+            [&](const auto& e) {return e.first == key;}));
+    }
+};
+
+#endif  // ARENA_POOL_H
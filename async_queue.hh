@@ -0,0 +1,262 @@
+#ifndef ASYNC_QUEUE_H
+#define ASYNC_QUEUE_H
+
+/* C++20, coroutines */
+
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <utility>
+
+#include "queue.hh"
+
+/**
+ * An executor is anything with
+ *
+ *   void post(std::coroutine_handle<> h);   resumes h later on its own thread
+ *
+ * async_queue resumes a waiting consumer through the executor it passed to
+ * pop(), never on the pushing thread.
+ */
+
+/**
+ * @brief Single-threaded event loop, a stand-in for the request executor
+ * @details post() may be called from any thread, run() resumes posted
+ *          coroutines one at a time on the calling thread until stop().
+ *          Several loops, one per thread, share the consumers of a
+ *          service between them.
+ */
+class event_loop
+{
+private:
+    /**< Ready coroutine frames, nullptr stops run() */
+    Queue<void *> m_ready;
+
+public:
+    event_loop() = default;
+    event_loop(event_loop const &) = delete;
+    event_loop& operator=(event_loop const &) = delete;
+
+    void post(std::coroutine_handle<> h) { m_ready.push(h.address()); }
+
+    void run()
+    {
+        while (void * p = m_ready.wait_and_pop())
+            std::coroutine_handle<>::from_address(p).resume();
+    }
+
+    /* run() returns once it gets to this, coroutines posted later stay put */
+    void stop() { m_ready.terminate(); }
+};
+
+/**
+ * @brief Coroutine started on an executor and left to finish on its own
+ * @details Suspends before its body, start() posts it. The frame goes when
+ *          the body returns; an exception out of the body terminates.
+ *
+ *          detached_task consume(async_queue<foo *> & q, event_loop & loop)
+ *          {
+ *              while (foo * f = co_await q.pop(loop))
+ *                  handle(f);
+ *          }
+ *
+ *          consume(q, loop).start(loop);
+ */
+class detached_task
+{
+public:
+    struct promise_type
+    {
+        detached_task get_return_object()
+        {
+            return detached_task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+
+    explicit detached_task(std::coroutine_handle<promise_type> h) : m_handle{h} {}
+
+public:
+    detached_task(detached_task && other) noexcept : m_handle{std::exchange(other.m_handle, nullptr)} {}
+    detached_task(detached_task const &) = delete;
+    detached_task& operator=(detached_task const &) = delete;
+    detached_task& operator=(detached_task &&) = delete;
+
+    /* Never started, nothing else refers to the frame */
+    ~detached_task()
+    {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    template<typename Executor>
+    void start(Executor & ex)
+    {
+        ex.post(std::exchange(m_handle, nullptr));
+    }
+};
+
+/**
+ * @brief Unbounded queue whose consumers are coroutines
+ * @details co_await q.pop(ex) takes the oldest item or suspends the
+ *          coroutine until push() hands it one; the consumer then resumes
+ *          on ex. Suspended consumers cost a frame each, not a thread, so
+ *          thousands of them can wait on a handful of event loops. Waiting
+ *          consumers are served first come first served.
+ *
+ *          Items and waiters are guarded by one mutex, held for a few
+ *          pointer moves. push() posts outside it.
+ *
+ *          terminate() wakes every waiting consumer with the terminator,
+ *          and later pops get one once the items are gone.
+ *
+ * @tparam T Element type, constructible from nullptr for terminate()
+ * @tparam Executor See above, event_loop by default
+ */
+template<typename T, typename Executor = event_loop>
+class async_queue final
+{
+public:
+    /**< Underlaying type */
+    using type = T;
+    /**< Queue type */
+    using data_type = T;
+    /**< Termination type */
+    using terminator = std::nullptr_t;
+
+    class pop_awaiter;
+
+private:
+    std::mutex m_mutex;
+    std::deque<data_type> m_items;
+    /**< Suspended consumers, oldest first, intrusive through pop_awaiter */
+    pop_awaiter * m_first = nullptr;
+    pop_awaiter * m_last = nullptr;
+    bool m_terminated = false;
+
+public:
+    /* Lives in the consumer's frame while it is suspended */
+    class pop_awaiter
+    {
+    private:
+        async_queue & m_queue;
+        Executor & m_executor;
+        std::coroutine_handle<> m_handle;
+        data_type m_value = terminator();
+        pop_awaiter * m_next = nullptr;
+
+        friend class async_queue;
+
+    public:
+        pop_awaiter(async_queue & q, Executor & ex) : m_queue{q}, m_executor{ex} {}
+
+        bool await_ready() const noexcept { return false; }
+
+        /* false resumes right away, an item was there */
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            std::lock_guard<std::mutex> lk{m_queue.m_mutex};
+
+            if (!m_queue.m_items.empty()) {
+                m_value = std::move(m_queue.m_items.front());
+                m_queue.m_items.pop_front();
+                return false;
+            }
+
+            if (m_queue.m_terminated)
+                return false;
+
+            m_handle = h;
+            if (m_queue.m_last)
+                m_queue.m_last->m_next = this;
+            else
+                m_queue.m_first = this;
+            m_queue.m_last = this;
+            return true;
+        }
+
+        data_type await_resume() { return std::move(m_value); }
+    };
+
+    async_queue() = default;
+    async_queue(async_queue const &) = delete;
+    async_queue& operator=(async_queue const &) = delete;
+
+    /* Waiting consumers must be gone by now */
+    ~async_queue() = default;
+
+    /**
+     * @brief co_await it for the next item
+     * @param ex Where the consumer resumes if it has to wait
+     */
+    pop_awaiter pop(Executor & ex) { return pop_awaiter{*this, ex}; }
+
+    /* The oldest item, or the terminator when there is none */
+    data_type try_pop()
+    {
+        std::lock_guard<std::mutex> lk{m_mutex};
+        if (m_items.empty())
+            return terminator();
+        data_type value = std::move(m_items.front());
+        m_items.pop_front();
+        return value;
+    }
+
+    /* Straight to the oldest waiting consumer if there is one */
+    void push(T new_value)
+    {
+        std::unique_lock<std::mutex> lk{m_mutex};
+
+        pop_awaiter * w = m_first;
+        if (!w) {
+            m_items.push_back(std::move(new_value));
+            return;
+        }
+
+        m_first = w->m_next;
+        if (!m_first)
+            m_last = nullptr;
+
+        w->m_value = std::move(new_value);
+        /* w goes as soon as its coroutine runs, copy out what post needs */
+        auto h = w->m_handle;
+        auto & ex = w->m_executor;
+        lk.unlock();
+
+        ex.post(h);
+    }
+
+    void terminate()
+    {
+        pop_awaiter * w;
+        {
+            std::lock_guard<std::mutex> lk{m_mutex};
+            m_terminated = true;
+            w = std::exchange(m_first, nullptr);
+            m_last = nullptr;
+        }
+
+        while (w) {
+            auto * next = w->m_next;
+            w->m_executor.post(w->m_handle);
+            w = next;
+        }
+    }
+
+    std::size_t size()
+    {
+        std::lock_guard<std::mutex> lk{m_mutex};
+        return m_items.size();
+    }
+};
+
+#endif  // ASYNC_QUEUE_H
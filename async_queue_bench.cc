@@ -0,0 +1,169 @@
+/* g++ -std=c++20 -O2 -pthread async_queue_bench.cc */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "async_queue.hh"
+#include "bench.hh"
+#include "queue.hh"
+
+/**
+ * Many consumers, each with its own queue (one per connection, say), fed
+ * round robin by one producer. A thread blocked in wait_and_pop() per
+ * consumer against coroutines suspended in co_await pop() multiplexed onto
+ * a few event loops. Each run starts its consumers from scratch, threads
+ * or coroutine frames, which is part of what is measured.
+ */
+
+struct message
+{
+    std::uint64_t pushed_ns;
+};
+
+/* Messages per run, spread over the consumers */
+constexpr std::size_t messages = 100000;
+
+std::uint64_t now_ns()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/* Push to resume latency of the last run */
+void add_latency(bench::result & r, std::vector<std::vector<double>> const & per_consumer)
+{
+    std::vector<double> all;
+    for (auto const & l : per_consumer)
+        all.insert(all.end(), l.begin(), l.end());
+
+    r.params.emplace_back("lat_p50_ns", std::to_string(bench::percentile(all, 50)));
+    r.params.emplace_back("lat_p99_ns", std::to_string(bench::percentile(all, 99)));
+}
+
+/* Round robin over the queues, then a terminator each */
+template<typename Q>
+void produce(std::vector<std::unique_ptr<Q>> & queues, std::vector<message> & msgs)
+{
+    for (std::size_t i = 0; i < msgs.size(); ++i) {
+        msgs[i].pushed_ns = now_ns();
+        queues[i % queues.size()]->push(&msgs[i]);
+    }
+
+    for (auto & q : queues)
+        q->terminate();
+}
+
+void bench_threads(bench::reporter & rep, std::size_t consumers)
+{
+    auto name = "thread per consumer, Queue::wait_and_pop";
+    if (!rep.wanted(name))
+        return;
+
+    using queue_type = Queue<message *>;
+    std::vector<message> msgs(messages);
+    std::vector<std::vector<double>> latency(consumers);
+
+    auto r = bench::run(name, {{"consumers", std::to_string(consumers)},
+                               {"threads", std::to_string(consumers + 1)}},
+                        rep.opts(), messages, [&] {
+        for (auto & l : latency)
+            l.clear();
+    }, [&] {
+        std::vector<std::unique_ptr<queue_type>> queues;
+        std::vector<std::thread> threads;
+
+        for (std::size_t c = 0; c < consumers; ++c)
+            queues.emplace_back(new queue_type{});
+
+        for (std::size_t c = 0; c < consumers; ++c)
+            threads.emplace_back([&, c] {
+                while (message * m = queues[c]->wait_and_pop())
+                    latency[c].push_back(static_cast<double>(now_ns() - m->pushed_ns));
+            });
+
+        produce(queues, msgs);
+
+        for (auto & t : threads)
+            t.join();
+    });
+
+    add_latency(r, latency);
+    rep.add(std::move(r));
+}
+
+using async_type = async_queue<message *>;
+
+detached_task consume(async_type & q, event_loop & loop, std::vector<double> & latency,
+                      std::atomic<std::size_t> & running, std::vector<event_loop> & loops)
+{
+    while (message * m = co_await q.pop(loop))
+        latency.push_back(static_cast<double>(now_ns() - m->pushed_ns));
+
+    /* Last one out stops the loops */
+    if (running.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        for (auto & l : loops)
+            l.stop();
+}
+
+void bench_coroutines(bench::reporter & rep, std::size_t consumers, std::size_t threads)
+{
+    auto name = "coroutines on event loops, co_await pop";
+    if (!rep.wanted(name))
+        return;
+
+    std::vector<message> msgs(messages);
+    std::vector<std::vector<double>> latency(consumers);
+
+    auto r = bench::run(name, {{"consumers", std::to_string(consumers)},
+                               {"threads", std::to_string(threads + 1)}},
+                        rep.opts(), messages, [&] {
+        for (auto & l : latency)
+            l.clear();
+    }, [&] {
+        std::vector<std::unique_ptr<async_type>> queues;
+        std::vector<event_loop> loops(threads);
+        std::vector<std::thread> workers;
+        std::atomic<std::size_t> running{consumers};
+
+        for (std::size_t c = 0; c < consumers; ++c)
+            queues.emplace_back(new async_type{});
+
+        for (std::size_t c = 0; c < consumers; ++c) {
+            auto & loop = loops[c % threads];
+            consume(*queues[c], loop, latency[c], running, loops).start(loop);
+        }
+
+        for (auto & l : loops)
+            workers.emplace_back([&l] { l.run(); });
+
+        produce(queues, msgs);
+
+        for (auto & t : workers)
+            t.join();
+    });
+
+    add_latency(r, latency);
+    rep.add(std::move(r));
+}
+
+int main(int argc, char ** argv)
+{
+    bench::reporter rep{bench::parse_args(argc, argv)};
+
+    auto threads = std::max<std::size_t>(2, std::thread::hardware_concurrency());
+
+    bench_threads(rep, 256);
+
+    for (std::size_t consumers : {256, 4096, 16384})
+        bench_coroutines(rep, consumers, threads);
+
+    rep.print(std::cout);
+}
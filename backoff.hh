@@ -0,0 +1,48 @@
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/* Tells the core we're in a spin loop (PAUSE on x86) */
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+/**
+ * @brief Spins with a pause for a while, then gives the core away
+ * @details One per wait loop:
+ *
+ *          backoff b;
+ *          while (!q.try_pop(v))
+ *              b.pause();
+ */
+class backoff
+{
+private:
+    /**< Pause rounds before backing off to yield */
+    static constexpr unsigned spin_limit = 64;
+
+    unsigned m_spins = 0;
+
+public:
+    void pause()
+    {
+        if (m_spins < spin_limit) {
+            ++m_spins;
+            cpu_relax();
+        }
+        else
+            std::this_thread::yield();
+    }
+
+    void reset() { m_spins = 0; }
+};
+
+#endif  // BACKOFF_H
@@ -0,0 +1,418 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Small benchmark harness for the experiments in this repo
+ * @details Each case gets warmup runs followed by timed runs, setup code
+ *          (shuffling, refilling) runs before every run outside the timed
+ *          region. Median and p99 of the runs are reported along with
+ *          hardware counters when perf_event_open is permitted.
+ *
+ *          bench::options opts = bench::parse_args(argc, argv);
+ *          bench::reporter rep{opts};
+ *          rep.add(bench::run("malloc", {{"size", "64"}}, opts, 100,
+ *                             [&] { shuffle(order); },
+ *                             [&] { for (auto i : order) ... }));
+ *          rep.print(std::cout);
+ */
+namespace bench
+{
+    enum class format { text, csv, json };
+
+    /* Knobs shared by every case */
+    struct options
+    {
+        /* Untimed runs before measuring */
+        std::size_t warmup = 3;
+        /* Timed runs */
+        std::size_t runs = 25;
+        /* Output format */
+        format fmt = format::text;
+        /* Only run cases whose name contains this */
+        std::string filter;
+    };
+
+    /* Free form key/value parameters printed with a case */
+    using params = std::vector<std::pair<std::string, std::string>>;
+
+    /* Hardware counters, per run medians */
+    struct counters
+    {
+        bool valid = false;
+        double cycles = 0;
+        double instructions = 0;
+        double cache_misses = 0;
+        double branch_misses = 0;
+    };
+
+    struct result
+    {
+        std::string name;
+        bench::params params;
+        /* Operations done by one run, for per op numbers */
+        std::size_t ops = 1;
+        double median_ns = 0;
+        double p99_ns = 0;
+        double min_ns = 0;
+        bench::counters counters;
+
+        double ns_per_op() const { return median_ns / ops; }
+    };
+
+    /**
+     * @brief Counts cycles, instructions, cache and branch misses of the
+     *          calling thread as one perf event group
+     * @details Quietly unavailable when the kernel refuses (containers,
+     *          perf_event_paranoid, non-Linux).
+     */
+    class perf_counters
+    {
+    private:
+        static constexpr std::size_t num_events = 4;
+
+        int m_fds[num_events];
+
+#ifdef __linux__
+        static int open_event(std::uint32_t type, std::uint64_t config, int group)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = group == -1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+
+            return static_cast<int>(::syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+        }
+#endif
+
+    public:
+        perf_counters()
+        {
+            std::fill(std::begin(m_fds), std::end(m_fds), -1);
+#ifdef __linux__
+            std::pair<std::uint32_t, std::uint64_t> const events[num_events] = {
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            };
+
+            for (std::size_t i = 0; i < num_events; ++i)
+            {
+                m_fds[i] = open_event(events[i].first, events[i].second, m_fds[0]);
+
+                if (m_fds[i] == -1) {
+                    close_all();
+                    return;
+                }
+            }
+#endif
+        }
+
+        perf_counters(perf_counters const &) = delete;
+        perf_counters& operator=(perf_counters const &) = delete;
+
+        ~perf_counters() { close_all(); }
+
+        bool available() const { return m_fds[0] != -1; }
+
+        void start()
+        {
+#ifdef __linux__
+            if (!available())
+                return;
+            ::ioctl(m_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ::ioctl(m_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+        }
+
+        /* Stops counting and returns the values since start() */
+        counters stop()
+        {
+            counters ret;
+#ifdef __linux__
+            if (!available())
+                return ret;
+
+            ::ioctl(m_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+            /* nr followed by one value per event */
+            std::uint64_t values[1 + num_events] = {0};
+            if (::read(m_fds[0], values, sizeof(values)) != sizeof(values))
+                return ret;
+
+            ret.valid = true;
+            ret.cycles = static_cast<double>(values[1]);
+            ret.instructions = static_cast<double>(values[2]);
+            ret.cache_misses = static_cast<double>(values[3]);
+            ret.branch_misses = static_cast<double>(values[4]);
+#endif
+            return ret;
+        }
+
+    private:
+        void close_all()
+        {
+#ifdef __linux__
+            for (auto & fd : m_fds)
+                if (fd != -1) {
+                    ::close(fd);
+                    fd = -1;
+                }
+#endif
+        }
+    };
+
+    /* Nearest rank percentile of unsorted values */
+    inline double percentile(std::vector<double> values, double pct)
+    {
+        if (values.empty())
+            return 0;
+
+        std::sort(values.begin(), values.end());
+        auto rank = static_cast<std::size_t>(pct / 100.0 * (values.size() - 1) + 0.5);
+        return values[std::min(rank, values.size() - 1)];
+    }
+
+    /**
+     * @brief Runs one case
+     * @param ops Operations done by one call of body
+     * @param setup Called before every run, not timed
+     * @param body Timed
+     */
+    template<typename Setup, typename Body>
+        result run(std::string name, params p, options const & opts, std::size_t ops,
+                   Setup && setup, Body && body)
+        {
+            result ret;
+            ret.name = std::move(name);
+            ret.params = std::move(p);
+            ret.ops = ops ? ops : 1;
+
+            for (std::size_t i = 0; i < opts.warmup; ++i)
+            {
+                setup();
+                body();
+            }
+
+            perf_counters perf;
+            std::vector<double> times;
+            std::vector<counters> counts;
+
+            for (std::size_t i = 0; i < opts.runs; ++i)
+            {
+                setup();
+
+                perf.start();
+                auto start = std::chrono::steady_clock::now();
+                body();
+                auto end = std::chrono::steady_clock::now();
+                counts.push_back(perf.stop());
+
+                times.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+            }
+
+            ret.median_ns = percentile(times, 50);
+            ret.p99_ns = percentile(times, 99);
+            ret.min_ns = percentile(times, 0);
+
+            if (!counts.empty() && counts.front().valid)
+            {
+                auto median_of = [&](double counters::* field) {
+                    std::vector<double> v;
+                    for (auto const & c : counts)
+                        v.push_back(c.*field);
+                    return percentile(v, 50);
+                };
+
+                ret.counters.valid = true;
+                ret.counters.cycles = median_of(&counters::cycles);
+                ret.counters.instructions = median_of(&counters::instructions);
+                ret.counters.cache_misses = median_of(&counters::cache_misses);
+                ret.counters.branch_misses = median_of(&counters::branch_misses);
+            }
+
+            return ret;
+        }
+
+    /* run() without setup */
+    template<typename Body>
+        result run(std::string name, params p, options const & opts, std::size_t ops, Body && body)
+        {
+            return run(std::move(name), std::move(p), opts, ops, [] {}, std::forward<Body>(body));
+        }
+
+    /**
+     * @brief Understands --format=text|csv|json, --runs=N, --warmup=N and
+     *          --filter=SUBSTRING, anything else is left alone
+     */
+    inline options parse_args(int argc, char ** argv)
+    {
+        options ret;
+
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg{argv[i]};
+            auto value = [&](char const * key) -> char const * {
+                auto len = std::strlen(key);
+                return arg.compare(0, len, key) == 0 ? arg.c_str() + len : nullptr;
+            };
+
+            if (auto v = value("--format=")) {
+                std::string f{v};
+                ret.fmt = f == "csv" ? format::csv : f == "json" ? format::json : format::text;
+            }
+            else if (auto v = value("--runs="))
+                ret.runs = std::max<std::size_t>(1, std::stoul(v));
+            else if (auto v = value("--warmup="))
+                ret.warmup = std::stoul(v);
+            else if (auto v = value("--filter="))
+                ret.filter = v;
+        }
+
+        return ret;
+    }
+
+    /* Collects results and prints them in the requested format */
+    class reporter
+    {
+    private:
+        options m_opts;
+        std::vector<result> m_results;
+
+        static std::string json_escape(std::string const & s)
+        {
+            std::string ret;
+            for (auto c : s)
+            {
+                if (c == '"' || c == '\\')
+                    ret += '\\';
+                ret += c;
+            }
+            return ret;
+        }
+
+        static std::string joined_params(result const & r, char sep)
+        {
+            std::string ret;
+            for (auto const & kv : r.params)
+            {
+                if (!ret.empty())
+                    ret += sep;
+                ret += kv.first + "=" + kv.second;
+            }
+            return ret;
+        }
+
+    public:
+        explicit reporter(options opts) : m_opts(std::move(opts)) {}
+
+        /* Whether a case passes --filter */
+        bool wanted(std::string const & name) const {
+            return m_opts.filter.empty() || name.find(m_opts.filter) != std::string::npos;
+        }
+
+        options const & opts() const { return m_opts; }
+
+        void add(result r)
+        {
+            /* Text goes out as we go so long suites show progress */
+            if (m_opts.fmt == format::text)
+                print_text(std::cout, r);
+            m_results.push_back(std::move(r));
+        }
+
+        void print_text(std::ostream & os, result const & r) const
+        {
+            os << std::left << std::setw(48) << r.name << " "
+               << std::setw(36) << joined_params(r, ' ') << std::right << std::fixed
+               << std::setprecision(1)
+               << " median " << std::setw(12) << r.median_ns / 1000.0 << "us"
+               << " p99 " << std::setw(12) << r.p99_ns / 1000.0 << "us"
+               << std::setprecision(2)
+               << " " << std::setw(10) << r.ns_per_op() << "ns/op";
+
+            if (r.counters.valid)
+                os << std::setprecision(0)
+                   << " cyc " << r.counters.cycles
+                   << " ins " << r.counters.instructions
+                   << " cmiss " << r.counters.cache_misses
+                   << " bmiss " << r.counters.branch_misses;
+
+            os << std::defaultfloat << std::endl;
+        }
+
+        void print(std::ostream & os) const
+        {
+            switch (m_opts.fmt)
+            {
+            case format::text:
+                break;
+
+            case format::csv:
+                os << "name,params,ops,median_ns,p99_ns,min_ns,ns_per_op,"
+                      "cycles,instructions,cache_misses,branch_misses\n";
+                for (auto const & r : m_results)
+                {
+                    os << r.name << "," << joined_params(r, ';') << "," << r.ops << ","
+                       << r.median_ns << "," << r.p99_ns << "," << r.min_ns << ","
+                       << r.ns_per_op() << ",";
+                    if (r.counters.valid)
+                        os << r.counters.cycles << "," << r.counters.instructions << ","
+                           << r.counters.cache_misses << "," << r.counters.branch_misses;
+                    else
+                        os << ",,,";
+                    os << "\n";
+                }
+                break;
+
+            case format::json:
+                os << "[\n";
+                for (std::size_t i = 0; i < m_results.size(); ++i)
+                {
+                    auto const & r = m_results[i];
+                    os << "  {\"name\": \"" << json_escape(r.name) << "\", \"params\": {";
+                    for (std::size_t j = 0; j < r.params.size(); ++j)
+                        os << (j ? ", " : "") << "\"" << json_escape(r.params[j].first)
+                           << "\": \"" << json_escape(r.params[j].second) << "\"";
+                    os << "}, \"ops\": " << r.ops
+                       << ", \"median_ns\": " << r.median_ns
+                       << ", \"p99_ns\": " << r.p99_ns
+                       << ", \"min_ns\": " << r.min_ns
+                       << ", \"ns_per_op\": " << r.ns_per_op();
+                    if (r.counters.valid)
+                        os << ", \"cycles\": " << r.counters.cycles
+                           << ", \"instructions\": " << r.counters.instructions
+                           << ", \"cache_misses\": " << r.counters.cache_misses
+                           << ", \"branch_misses\": " << r.counters.branch_misses;
+                    os << "}" << (i + 1 < m_results.size() ? "," : "") << "\n";
+                }
+                os << "]\n";
+                break;
+            }
+        }
+    };
+}
+
+#endif  // BENCH_H
@@ -0,0 +1,359 @@
+#ifndef CHUNKED_LINEAR_OBJECT_STORAGE_H
+#define CHUNKED_LINEAR_OBJECT_STORAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <sys/mman.h>
+
+/**
+ * @brief Growable object storage made of fixed size slabs
+ * @details Single object allocations only. Each slab is a small header
+ *          plus at least SlabSlots objects, as many as fill the next power
+ *          of two size, and is aligned to that size, so deallocate finds
+ *          the owning slab by
+ *          masking the pointer. Slabs are added on demand and never move,
+ *          fully free slabs past a threshold are given back. Memory is
+ *          handed out uninitialized, see object_pool for constructed objects.
+ *
+ *          chunked_linear_object_storage<foo, 512> alloc{{true, true, 4}};
+ *          auto * p = alloc.allocate(1);
+ *          alloc.deallocate(p, 1);
+ *
+ * @tparam T Object type
+ * @tparam SlabSlots Minimum number of slots per slab, see slots_per_slab()
+ */
+template<typename T, std::size_t SlabSlots>
+class chunked_linear_object_storage
+{
+public:
+    /* Runtime knobs */
+    struct options
+    {
+        /* Get slabs from mmap instead of operator new */
+        bool use_mmap;
+        /* Ask for huge pages, MAP_HUGETLB first then madvise(MADV_HUGEPAGE) */
+        bool huge_pages;
+        /* Fully free slabs kept around before returning them */
+        std::size_t max_free_slabs;
+    };
+
+private:
+    static_assert(SlabSlots > 0, "slabs need at least one slot");
+
+    /* Free slots hold the index of the next free slot in place of a T */
+    union slot_type
+    {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type object;
+        std::size_t next;
+    };
+
+    struct slab;
+
+    /* Intrusive list hook */
+    struct link
+    {
+        slab * prev;
+        slab * next;
+    };
+
+    struct slab_header
+    {
+        /* Slabs with free slots */
+        link available;
+        /* Every slab */
+        link all;
+        /* Came from mmap and needs munmap */
+        bool mapped;
+        /* How many slots are used */
+        std::size_t used;
+        /* First free slot index, slab_slots if the free list is empty */
+        std::size_t free_head;
+        /* Slots at or past this index have never been handed out */
+        std::size_t free_untouched;
+    };
+
+    static constexpr std::size_t next_pow2(std::size_t n, std::size_t p = 1)
+    {
+        return p >= n ? p : next_pow2(n, p * 2);
+    }
+
+    /* Where the slots start after the header */
+    static constexpr std::size_t slots_offset =
+        (sizeof(slab_header) + alignof(slot_type) - 1) / alignof(slot_type) * alignof(slot_type);
+
+    /* Every slab is this big and aligned to it */
+    static constexpr std::size_t slab_bytes = next_pow2(slots_offset + SlabSlots * sizeof(slot_type));
+
+    /* SlabSlots rounded up to use all of slab_bytes */
+    static constexpr std::size_t slab_slots = (slab_bytes - slots_offset) / sizeof(slot_type);
+
+    struct slab : slab_header
+    {
+        slot_type slots[slab_slots];
+    };
+
+    static_assert(sizeof(slab) <= slab_bytes, "slab header layout is off");
+
+    /* Huge page size on the platforms we care about */
+    static constexpr std::size_t huge_page = 2 * 1024 * 1024;
+
+    /* Pointer to list hook member */
+    using hook = link slab::*;
+
+    struct list
+    {
+        slab * head;
+        slab * tail;
+    };
+
+    options m_options;
+    /* Slabs with free slots, partially used ones first */
+    list m_available;
+    /* Every slab */
+    list m_all;
+    /* Number of slabs */
+    std::size_t m_slabs;
+    /* Number of slabs with nothing used */
+    std::size_t m_free_slabs;
+    /* How many slots are used */
+    std::size_t m_slots_used;
+    /* Max slots ever used */
+    std::size_t m_high_water;
+
+    static void push_front(list & l, hook h, slab * s)
+    {
+        (s->*h).prev = nullptr;
+        (s->*h).next = l.head;
+        if (l.head)
+            (l.head->*h).prev = s;
+        else
+            l.tail = s;
+        l.head = s;
+    }
+
+    static void push_back(list & l, hook h, slab * s)
+    {
+        (s->*h).next = nullptr;
+        (s->*h).prev = l.tail;
+        if (l.tail)
+            (l.tail->*h).next = s;
+        else
+            l.head = s;
+        l.tail = s;
+    }
+
+    static void unlink(list & l, hook h, slab * s)
+    {
+        auto & lk = s->*h;
+        if (lk.prev)
+            (lk.prev->*h).next = lk.next;
+        else
+            l.head = lk.next;
+        if (lk.next)
+            (lk.next->*h).prev = lk.prev;
+        else
+            l.tail = lk.prev;
+    }
+
+    void * map_slab()
+    {
+        /* Over-map so an aligned slab_bytes window fits, trim the rest */
+        auto length = 2 * slab_bytes;
+        void * p = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+        if (m_options.huge_pages && slab_bytes % huge_page == 0)
+            p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        bool huge = p != MAP_FAILED;
+
+        if (!huge)
+            p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (p == MAP_FAILED)
+            throw std::bad_alloc{};
+
+        auto begin = reinterpret_cast<std::uintptr_t>(p);
+        auto aligned = (begin + slab_bytes - 1) & ~(slab_bytes - 1);
+
+        /* Huge page mappings can only be split on huge page boundaries,
+         * which slab_bytes is a multiple of, so trimming is safe either way */
+        if (aligned != begin)
+            ::munmap(p, aligned - begin);
+        if (begin + length != aligned + slab_bytes)
+            ::munmap(reinterpret_cast<void *>(aligned + slab_bytes),
+                     begin + length - aligned - slab_bytes);
+
+#ifdef MADV_HUGEPAGE
+        if (m_options.huge_pages && !huge)
+            ::madvise(reinterpret_cast<void *>(aligned), slab_bytes, MADV_HUGEPAGE);
+#endif
+
+        return reinterpret_cast<void *>(aligned);
+    }
+
+    slab * add_slab()
+    {
+        void * mem = m_options.use_mmap ?
+            map_slab() : ::operator new(slab_bytes, std::align_val_t{slab_bytes});
+
+        auto * s = ::new(mem) slab;
+        s->mapped = m_options.use_mmap;
+        s->used = 0;
+        s->free_head = slab_slots;
+        s->free_untouched = 0;
+
+        push_front(m_available, &slab::available, s);
+        push_back(m_all, &slab::all, s);
+        ++m_slabs;
+        ++m_free_slabs;
+
+        return s;
+    }
+
+    /* Gives a slab back, it must already be off m_available */
+    void release_slab(slab * s)
+    {
+        unlink(m_all, &slab::all, s);
+        --m_slabs;
+
+        auto mapped = s->mapped;
+        s->~slab();
+
+        if (mapped)
+            ::munmap(s, slab_bytes);
+        else
+            ::operator delete(s, std::align_val_t{slab_bytes});
+    }
+
+    slab * slab_of(T * obj) const
+    {
+        return reinterpret_cast<slab *>(reinterpret_cast<std::uintptr_t>(obj) & ~(slab_bytes - 1));
+    }
+
+public:
+    /* alias */
+    using value_type = T;
+
+    /* Only the allocate/deallocate half of an allocator: it owns its slabs
+     * so it can't be copied, containers need a handle that refers to it */
+    template <class _Up>
+        struct rebind {
+            using other = chunked_linear_object_storage<_Up, SlabSlots>;
+        };
+
+    chunked_linear_object_storage() noexcept :
+        chunked_linear_object_storage(options{false, false, 1})
+    {}
+
+    explicit chunked_linear_object_storage(options opts) noexcept :
+        m_options(opts),
+        m_available{nullptr, nullptr},
+        m_all{nullptr, nullptr},
+        m_slabs{0},
+        m_free_slabs{0},
+        m_slots_used{0},
+        m_high_water{0}
+    {}
+
+    /* Owns its slabs */
+    chunked_linear_object_storage(chunked_linear_object_storage const &) = delete;
+    chunked_linear_object_storage& operator=(chunked_linear_object_storage const &) = delete;
+
+    ~chunked_linear_object_storage() {
+        /* Outstanding objects are the caller's problem, the memory isn't */
+        while (m_all.head)
+            release_slab(m_all.head);
+    }
+
+    std::pair<std::size_t, std::size_t> get_info() const {
+        return std::make_pair(m_slots_used, m_high_water);
+    }
+
+    /* Slabs currently held */
+    std::size_t slabs() const {
+        return m_slabs;
+    }
+
+    /* Bytes of memory per slab */
+    static constexpr std::size_t slab_size() {
+        return slab_bytes;
+    }
+
+    /* Objects per slab, SlabSlots or more */
+    static constexpr std::size_t slots_per_slab() {
+        return slab_slots;
+    }
+
+    T * allocate(std::size_t num)
+    {
+        if (num != 1)
+            throw std::bad_alloc{};
+
+        auto * s = m_available.head ? m_available.head : add_slab();
+
+        if (s->used == 0)
+            --m_free_slabs;
+
+        std::size_t slot;
+
+        /* Reuse a released slot first, then carve from untouched ones */
+        if (s->free_head != slab_slots) {
+            slot = s->free_head;
+            s->free_head = s->slots[slot].next;
+        }
+        else
+            slot = s->free_untouched++;
+
+        if (++s->used == slab_slots)
+            unlink(m_available, &slab::available, s);
+
+        auto * ret = reinterpret_cast<T *>(&s->slots[slot]);
+
+        if (++m_slots_used > m_high_water)
+            m_high_water = m_slots_used;
+
+        return ret;
+    }
+
+    void deallocate(T * obj, std::size_t num)
+    {
+        auto * s = slab_of(obj);
+        auto * p = reinterpret_cast<slot_type *>(obj);
+
+        if (num != 1 || p < s->slots || p >= s->slots + slab_slots)
+            throw std::bad_alloc{};
+
+        /* Push it on the slab's free list */
+        auto slot = static_cast<std::size_t>(p - s->slots);
+        s->slots[slot].next = s->free_head;
+        s->free_head = slot;
+        --m_slots_used;
+
+        if (s->used-- == slab_slots)
+            push_front(m_available, &slab::available, s);
+
+        if (s->used == 0)
+        {
+            ++m_free_slabs;
+
+            /* Free slabs go to the back so partial ones fill up first */
+            unlink(m_available, &slab::available, s);
+
+            if (m_free_slabs > m_options.max_free_slabs) {
+                --m_free_slabs;
+                release_slab(s);
+            }
+            else
+                push_back(m_available, &slab::available, s);
+        }
+    }
+};
+
+#endif  // CHUNKED_LINEAR_OBJECT_STORAGE_H
@@ -0,0 +1,218 @@
+#ifndef CONCURRENT_LINEAR_OBJECT_STORAGE_H
+#define CONCURRENT_LINEAR_OBJECT_STORAGE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @brief Thread-safe fixed capacity object storage
+ * @details Single object allocations only. Free slot indices are kept on a
+ *          lock-free (Treiber) stack whose head carries a tag that is bumped
+ *          on every update, so a slot popped and pushed back between a
+ *          thread's load and its CAS does not go unnoticed (ABA). Memory
+ *          is handed out uninitialized, see object_pool for constructed
+ *          objects.
+ * @tparam T Object type
+ * @tparam N Number of slots
+ */
+template<typename T, std::size_t N>
+class concurrent_linear_object_storage
+{
+private:
+    static_assert(N < std::numeric_limits<std::uint32_t>::max(),
+                  "slot indices must fit in 32 bits");
+
+    using slot_type = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    /* End of list marker */
+    static constexpr std::uint32_t nil = static_cast<std::uint32_t>(N);
+
+    /* Keeps the hot atomics on their own cache lines */
+    static constexpr std::size_t cache_line = 64;
+
+    /* Head of the free stack, (tag << 32) | index */
+    alignas(cache_line) std::atomic<std::uint64_t> m_free_head;
+    /* How many slots are used */
+    alignas(cache_line) std::atomic<std::size_t> m_slots_used;
+    /* Max slots ever used */
+    std::atomic<std::size_t> m_high_water;
+    /* Next free slot for each free slot */
+    alignas(cache_line) std::atomic<std::uint32_t> m_next[N];
+
+    slot_type storage[N];
+
+    static std::uint64_t make_head(std::uint64_t tag, std::uint32_t index)
+    {
+        return (tag << 32) | index;
+    }
+
+    static std::uint32_t head_index(std::uint64_t head)
+    {
+        return static_cast<std::uint32_t>(head);
+    }
+
+    static std::uint64_t head_tag(std::uint64_t head)
+    {
+        return head >> 32;
+    }
+
+    void clear()
+    {
+        for (std::size_t i = 0; i < N; ++i)
+            m_next[i].store(static_cast<std::uint32_t>(i + 1), std::memory_order_relaxed);
+
+        m_free_head.store(make_head(0, N ? 0 : nil), std::memory_order_relaxed);
+        m_slots_used.store(0, std::memory_order_relaxed);
+    }
+
+    /* Pops up to num slots with one CAS, returns how many */
+    std::size_t pop_slots(std::uint32_t * out, std::size_t num)
+    {
+        auto head = m_free_head.load(std::memory_order_acquire);
+
+        for (;;)
+        {
+            /* The chain below an unchanged tag is unchanged too, so a
+             * stale walk is caught by the CAS */
+            std::size_t n = 0;
+            auto index = head_index(head);
+
+            while (index != nil && n < num)
+            {
+                out[n++] = index;
+                index = m_next[index].load(std::memory_order_relaxed);
+            }
+
+            if (n == 0)
+                return 0;
+
+            if (m_free_head.compare_exchange_weak(head, make_head(head_tag(head) + 1, index),
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_acquire))
+                return n;
+        }
+    }
+
+    /* Pushes num slots with one CAS */
+    void push_slots(std::uint32_t const * in, std::size_t num)
+    {
+        for (std::size_t i = 0; i + 1 < num; ++i)
+            m_next[in[i]].store(in[i + 1], std::memory_order_relaxed);
+
+        auto head = m_free_head.load(std::memory_order_relaxed);
+
+        do {
+            m_next[in[num - 1]].store(head_index(head), std::memory_order_relaxed);
+        } while (!m_free_head.compare_exchange_weak(head, make_head(head_tag(head) + 1, in[0]),
+                                                    std::memory_order_release,
+                                                    std::memory_order_relaxed));
+    }
+
+    void update_high_water(std::size_t used)
+    {
+        auto high = m_high_water.load(std::memory_order_relaxed);
+
+        while (used > high &&
+               !m_high_water.compare_exchange_weak(high, used, std::memory_order_relaxed))
+            ;
+    }
+
+public:
+    /* alias */
+    using value_type = T;
+
+    /* Only the allocate/deallocate half of an allocator: it owns its slots
+     * so it can't be copied, containers need a handle that refers to it */
+    template <class _Up>
+        struct rebind {
+            using other = concurrent_linear_object_storage<_Up, N>;
+        };
+
+    concurrent_linear_object_storage() noexcept :
+        m_high_water{0}
+    {
+        clear();
+    }
+
+    /* Atomics and outstanding pointers make copies meaningless */
+    concurrent_linear_object_storage(concurrent_linear_object_storage const &) = delete;
+    concurrent_linear_object_storage& operator=(concurrent_linear_object_storage const &) = delete;
+
+    std::pair<std::size_t, std::size_t> get_info() const {
+        return std::make_pair(m_slots_used.load(std::memory_order_relaxed),
+                              m_high_water.load(std::memory_order_relaxed));
+    }
+
+    T * allocate(std::size_t num)
+    {
+        if (num != 1)
+            throw std::bad_alloc{};
+
+        std::uint32_t slot;
+
+        if (!acquire_slots(&slot, 1))
+            throw std::bad_alloc{};
+
+        return slot_address(slot);
+    }
+
+    void deallocate(T * obj, std::size_t num)
+    {
+        if (num != 1)
+            throw std::bad_alloc{};
+
+        auto slot = slot_index(obj);
+
+        release_slots(&slot, 1);
+    }
+
+    /**
+     * @brief Takes up to num free slots without constructing anything
+     * @return How many slot indices were written to out
+     */
+    std::size_t acquire_slots(std::uint32_t * out, std::size_t num)
+    {
+        auto n = pop_slots(out, num);
+
+        if (n)
+            update_high_water(m_slots_used.fetch_add(n, std::memory_order_relaxed) + n);
+
+        return n;
+    }
+
+    /**
+     * @brief Gives back num slots taken by acquire_slots
+     */
+    void release_slots(std::uint32_t const * in, std::size_t num)
+    {
+        if (num == 0)
+            return;
+
+        push_slots(in, num);
+        m_slots_used.fetch_sub(num, std::memory_order_relaxed);
+    }
+
+    /* Raw memory of a slot */
+    T * slot_address(std::uint32_t slot)
+    {
+        return reinterpret_cast<T *>(storage + slot);
+    }
+
+    /* Slot holding obj, throws std::bad_alloc if obj is not from this pool */
+    std::uint32_t slot_index(T * obj) const
+    {
+        auto * p = reinterpret_cast<slot_type const *>(obj);
+
+        if (p < storage || p >= storage + N)
+            throw std::bad_alloc{};
+
+        return static_cast<std::uint32_t>(p - storage);
+    }
+};
+
+#endif  // CONCURRENT_LINEAR_OBJECT_STORAGE_H
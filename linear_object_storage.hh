@@ -1,3 +1,6 @@
+#ifndef LINEAR_OBJECT_STORAGE_H
+#define LINEAR_OBJECT_STORAGE_H
+
 #include <algorithm>
 #include <array>
 #include <iostream>
@@ -6,34 +9,291 @@
 #include <type_traits>
 #include <utility>
 #include <cstddef>
+#include <cstdint>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 /**
- * @brief
- * @tparam T
- * @tparam N
+ * @brief Fixed capacity object storage usable as a std::allocator
+ * @tparam T Object type
+ * @tparam N Number of slots
+ * @tparam FreeList When true, only single object allocations are allowed and
+ *          they are served from an intrusive free list of slot indices in
+ *          O(1). Otherwise runs of slots are searched for in an
+ *          occupancy bitmap, one bit per slot, with a summary level of
+ *          one bit per fully used bitmap word so full regions are skipped.
+ *
+ *          This is a raw memory allocator: allocate hands out uninitialized
+ *          slots and deallocate runs no destructors, the container (or
+ *          object_pool) owns construction.
  */
-template<typename T, std::size_t N>
+template<typename T, std::size_t N, bool FreeList = false>
 class linear_object_storage
 {
 private:
-    /* How many m_use_map slots are used */
+    /* Free slots hold the index of the next free slot in place of a T */
+    union free_slot
+    {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type object;
+        std::size_t next;
+    };
+
+    using slot_type = typename std::conditional<FreeList,
+          free_slot,
+          typename std::aligned_storage<sizeof(T), alignof(T)>::type>::type;
+
+    /* Bookkeeping only needed by the searching mode */
+    static constexpr std::size_t search_slots = FreeList ? 0 : N;
+    static constexpr std::size_t word_bits = 64;
+    static constexpr std::size_t bitmap_words = (search_slots + word_bits - 1) / word_bits;
+    static constexpr std::size_t summary_words = (bitmap_words + word_bits - 1) / word_bits;
+    static constexpr std::uint64_t all_ones = ~std::uint64_t{0};
+
+    /* How many slots are used */
     std::size_t m_slots_used;
     /* Max slots ever used */
     std::size_t m_high_water;
-    /* Index/Slot availability */
-    std::array<bool, N> m_use_map_mark;
-    /* Allocated pointers (mostly for deallocating) */
-    std::array<T *, N> m_use_map;
+    /* Slot occupancy, bit set when used. Bits past N are always set */
+    std::array<std::uint64_t, bitmap_words> m_used_bits;
+    /* Bit set when the matching m_used_bits word is all ones */
+    std::array<std::uint64_t, summary_words> m_full_words;
+    /* First free slot index, N if the free list is empty */
+    std::size_t m_free_head;
+    /* Slots at or past this index have never been handed out */
+    std::size_t m_free_untouched;
 
-    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage[N];
+    slot_type storage[N];
 
     void clear()
     {
-        for (auto & i : m_use_map_mark) i = false;
-        for (auto & i : m_use_map) i = nullptr;
+        for (auto & i : m_used_bits) i = 0;
+        for (auto & i : m_full_words) i = 0;
+
+        /* Padding never looks free */
+        if (search_slots % word_bits)
+            m_used_bits[bitmap_words - 1] = all_ones << (search_slots % word_bits);
+        if (bitmap_words % word_bits)
+            m_full_words[summary_words - 1] = all_ones << (bitmap_words % word_bits);
+        m_free_head = N;
+        m_free_untouched = 0;
         m_slots_used = 0;
     }
 
+    void update_high_water()
+    {
+        if (m_slots_used > m_high_water)
+            m_high_water = m_slots_used;
+    }
+
+    T * allocate(std::size_t num, std::true_type /* free list */)
+    {
+        if (num != 1)
+            throw std::bad_alloc{};
+
+        std::size_t slot;
+
+        /* Reuse a released slot first, then carve from untouched ones */
+        if (m_free_head != N) {
+            slot = m_free_head;
+            m_free_head = storage[slot].next;
+        }
+        else if (m_free_untouched != N)
+            slot = m_free_untouched++;
+        else
+            throw std::bad_alloc{};
+
+        auto * ret = reinterpret_cast<T *>(&storage[slot]);
+
+        ++m_slots_used;
+        update_high_water();
+
+        return ret;
+    }
+
+    void deallocate(T * obj, std::size_t num, std::true_type /* free list */)
+    {
+        auto * p = reinterpret_cast<slot_type *>(obj);
+
+        if (num != 1 || p < storage || p >= storage + N)
+            throw std::bad_alloc{};
+
+        /* Push it on the free list */
+        auto slot = static_cast<std::size_t>(p - storage);
+        storage[slot].next = m_free_head;
+        m_free_head = slot;
+        --m_slots_used;
+    }
+
+    static std::uint64_t low_mask(std::size_t n)
+    {
+        return n >= word_bits ? all_ones : ((std::uint64_t{1} << n) - 1);
+    }
+
+    /* Calls f(word, mask) for each bitmap word covering [first, first + num) */
+    template<typename F>
+    static void for_each_word(std::size_t first, std::size_t num, F && f)
+    {
+        while (num)
+        {
+            auto bit = first % word_bits;
+            auto n = std::min(num, word_bits - bit);
+            f(first / word_bits, low_mask(n) << bit);
+            first += n;
+            num -= n;
+        }
+    }
+
+    void mark_slots(std::size_t first, std::size_t num, bool used)
+    {
+        for_each_word(first, num, [this, used](std::size_t w, std::uint64_t mask) {
+            if (used)
+                m_used_bits[w] |= mask;
+            else
+                m_used_bits[w] &= ~mask;
+
+            auto full = std::uint64_t{1} << (w % word_bits);
+
+            if (m_used_bits[w] == all_ones)
+                m_full_words[w / word_bits] |= full;
+            else
+                m_full_words[w / word_bits] &= ~full;
+        });
+    }
+
+    bool slots_used(std::size_t first, std::size_t num) const
+    {
+        bool ret = true;
+        for_each_word(first, num, [this, &ret](std::size_t w, std::uint64_t mask) {
+            ret = ret && (m_used_bits[w] & mask) == mask;
+        });
+        return ret;
+    }
+
+    /* First bitmap word at or after w with a free slot */
+    std::size_t next_nonfull_word(std::size_t w) const
+    {
+        while (w < bitmap_words)
+        {
+            auto nonfull = ~m_full_words[w / word_bits] >> (w % word_bits);
+            if (nonfull)
+                return w + __builtin_ctzll(nonfull);
+            w = (w / word_bits + 1) * word_bits;
+        }
+
+        return bitmap_words;
+    }
+
+    /* Start of the first run of num free slots, or N */
+    std::size_t find_free_run(std::size_t num) const
+    {
+        /* Free slots carried over from the words before w */
+        std::size_t run = 0;
+        std::size_t run_start = 0;
+
+        for (auto w = next_nonfull_word(0); w < bitmap_words;)
+        {
+#ifdef __AVX2__
+            /* Long runs can swallow four empty words at a time */
+            while (num - run > 4 * word_bits && w + 4 <= bitmap_words)
+            {
+                auto v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(&m_used_bits[w]));
+                if (!_mm256_testz_si256(v, v))
+                    break;
+                if (run == 0)
+                    run_start = w * word_bits;
+                run += 4 * word_bits;
+                w += 4;
+            }
+
+            if (w == bitmap_words)
+                break;
+#endif
+            auto used = m_used_bits[w];
+            auto base = w * word_bits;
+
+            if (used == 0)
+            {
+                if (run == 0)
+                    run_start = base;
+                run += word_bits;
+                if (run >= num)
+                    return run_start;
+                ++w;
+                continue;
+            }
+
+            /* Free bits at the bottom extend the carried run */
+            if (run + __builtin_ctzll(used) >= num)
+                return run ? run_start : base;
+
+            /* Runs entirely inside this word */
+            auto free = ~used;
+            if (num <= word_bits && static_cast<std::size_t>(__builtin_popcountll(free)) >= num)
+            {
+                /* Bit i survives when bits [i, i + num) are all free */
+                auto starts = free;
+                for (std::size_t len = 1; len < num;)
+                {
+                    auto step = std::min(len, num - len);
+                    starts &= starts >> step;
+                    len += step;
+                }
+
+                if (starts)
+                    return base + __builtin_ctzll(starts);
+            }
+
+            /* Free bits at the top start a new run */
+            run = (used >> (word_bits - 1)) ? 0 : __builtin_clzll(used);
+            run_start = base + word_bits - run;
+
+            w = run ? w + 1 : next_nonfull_word(w + 1);
+        }
+
+        return N;
+    }
+
+    T * allocate(std::size_t num, std::false_type /* search */)
+    {
+        if (num == 0 || num > N)
+            throw std::bad_alloc{};
+
+        /* Find group of num slots available */
+        auto slot_start = find_free_run(num);
+
+        if (slot_start == N)
+            throw std::bad_alloc{};
+
+        /* alloc from storage */
+        auto * ret = reinterpret_cast<T *>(storage + slot_start);
+
+        mark_slots(slot_start, num, true);
+
+        m_slots_used += num;
+        update_high_water();
+
+        return ret;
+    }
+
+    void deallocate(T * obj, std::size_t num, std::false_type /* search */)
+    {
+        auto * p = reinterpret_cast<slot_type *>(obj);
+
+        if (p < storage || p >= storage + N)
+            throw std::bad_alloc{};
+
+        auto slot_start = static_cast<std::size_t>(p - storage);
+
+        if (num > N - slot_start || !slots_used(slot_start, num))
+            throw std::bad_alloc{};
+
+        /* Mark them unused */
+        mark_slots(slot_start, num, false);
+        m_slots_used -= num;
+    }
+
 public:
     /* alias */
     using value_type = T;
@@ -41,7 +301,7 @@ public:
     /* Required for std::allocator interop */
     template <class _Up>
         struct rebind { 
-            using other = linear_object_storage<_Up, N>;
+            using other = linear_object_storage<_Up, N, FreeList>;
         };
 
     linear_object_storage() noexcept :
@@ -64,57 +324,22 @@ public:
         return std::make_pair(m_slots_used, m_high_water);
     }
 
+    /* Whether p points into one of the slots */
+    bool owns(void const * p) const {
+        auto const * s = reinterpret_cast<unsigned char const *>(storage);
+        auto const * c = static_cast<unsigned char const *>(p);
+        return s <= c && c < s + sizeof(storage);
+    }
+
     T * allocate(std::size_t num)
     {
-        /* Find group of num slots available */
-        auto slot_range_start_ = std::search_n(m_use_map_mark.cbegin(), m_use_map_mark.cend(), num, false);
-        auto slot_range_start = std::distance(m_use_map_mark.cbegin(), slot_range_start_);
-
-        if (slot_range_start_ == m_use_map_mark.cend() || (slot_range_start + num > N))
-            throw std::bad_alloc{};
-
-        /* alloc from storage */
-        auto * ret = (new(storage + m_slots_used) T[num]);
-        auto * ret_ = ret;
-
-        /* store the pointers */
-        for (std::size_t i = 0; i < num; ++i)
-        {
-            auto t = slot_range_start + i;
-            m_use_map_mark[t] = true;
-            m_use_map[t] = ret_++;
-        }
-
-        m_slots_used += num;
-
-        if (m_slots_used > m_high_water)
-            m_high_water = m_slots_used;
-
-        return ret;
+        return allocate(num, std::integral_constant<bool, FreeList>{});
     }
 
     void deallocate(T * obj, std::size_t num)
     {
-        /* Find obj in the use map */
-        auto found = std::find(m_use_map.cbegin(), m_use_map.cend(), obj);
-        auto slot_start = std::distance(m_use_map.cbegin(), found);
-
-        if (found == m_use_map.cend() || (slot_start + num > N))
-            throw std::bad_alloc{};
-
-        for (std::size_t i = 0; i < num; ++i)
-        {
-            auto t = slot_start + i;
-
-            /* Destruct */
-            auto * obj = m_use_map[t];
-            obj->~T();
-            obj = nullptr;
-
-            /* Mark it unused */
-            m_use_map_mark[t] = false;
-            --m_slots_used;
-        }
+        deallocate(obj, num, std::integral_constant<bool, FreeList>{});
     }
 };
 
+#endif  // LINEAR_OBJECT_STORAGE_H
@@ -0,0 +1,133 @@
+#ifndef LINEAR_OBJECT_STORAGE_CACHE_H
+#define LINEAR_OBJECT_STORAGE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+/**
+ * @brief Per-thread magazine of free slots in front of a shared pool
+ * @details Each thread owns one cache per pool. Allocations pop a slot from
+ *          the magazine and deallocations push one back, so an alloc/free
+ *          pair never touches shared state. An empty magazine is refilled
+ *          with magazine_size slots in one pool operation, and a full one
+ *          (twice magazine_size) hands magazine_size slots back the same way.
+ *
+ *          concurrent_linear_object_storage<foo, 4096> pool;
+ *
+ *          // in each thread
+ *          linear_object_storage_cache<decltype(pool)> cache{pool, 32};
+ *          auto * p = cache.allocate(1);
+ *          cache.deallocate(p, 1);
+ *
+ * @tparam Pool Shared pool providing acquire_slots/release_slots,
+ *          slot_address and slot_index (concurrent_linear_object_storage)
+ */
+template<typename Pool>
+class linear_object_storage_cache
+{
+public:
+    /* alias */
+    using value_type = typename Pool::value_type;
+    using pool_type = Pool;
+
+    /* Hit/miss counts of one cache */
+    struct stats
+    {
+        /* Allocations served from the magazine */
+        std::size_t hits;
+        /* Allocations that had to refill from the pool */
+        std::size_t misses;
+        /* Batches handed back to the pool */
+        std::size_t flushes;
+
+        double hit_rate() const {
+            auto total = hits + misses;
+            return total ? static_cast<double>(hits) / total : 0.0;
+        }
+    };
+
+private:
+    using T = value_type;
+
+    /* Shared pool */
+    pool_type & m_pool;
+    /* Slots moved per refill or flush */
+    std::size_t m_magazine_size;
+    /* Cached free slot indices, at most 2 * m_magazine_size */
+    std::vector<std::uint32_t> m_magazine;
+    /* Counters for sizing the magazine */
+    stats m_stats;
+
+    void refill()
+    {
+        auto have = m_magazine.size();
+        m_magazine.resize(have + m_magazine_size);
+        m_magazine.resize(have + m_pool.acquire_slots(m_magazine.data() + have, m_magazine_size));
+    }
+
+    void flush(std::size_t num)
+    {
+        m_pool.release_slots(m_magazine.data() + m_magazine.size() - num, num);
+        m_magazine.resize(m_magazine.size() - num);
+        ++m_stats.flushes;
+    }
+
+public:
+    linear_object_storage_cache(pool_type & pool, std::size_t magazine_size = 32) :
+        m_pool(pool),
+        m_magazine_size{magazine_size ? magazine_size : 1},
+        m_stats{0, 0, 0}
+    {
+        m_magazine.reserve(2 * m_magazine_size);
+    }
+
+    linear_object_storage_cache(linear_object_storage_cache const &) = delete;
+    linear_object_storage_cache& operator=(linear_object_storage_cache const &) = delete;
+
+    ~linear_object_storage_cache() {
+        if (!m_magazine.empty())
+            flush(m_magazine.size());
+    }
+
+    stats get_stats() const {
+        return m_stats;
+    }
+
+    T * allocate(std::size_t num)
+    {
+        if (num != 1)
+            throw std::bad_alloc{};
+
+        if (!m_magazine.empty())
+            ++m_stats.hits;
+        else {
+            ++m_stats.misses;
+            refill();
+
+            if (m_magazine.empty())
+                throw std::bad_alloc{};
+        }
+
+        auto slot = m_magazine.back();
+        m_magazine.pop_back();
+
+        return m_pool.slot_address(slot);
+    }
+
+    void deallocate(T * obj, std::size_t num)
+    {
+        if (num != 1)
+            throw std::bad_alloc{};
+
+        auto slot = m_pool.slot_index(obj);
+
+        if (m_magazine.size() == 2 * m_magazine_size)
+            flush(m_magazine_size);
+
+        m_magazine.push_back(slot);
+    }
+};
+
+#endif  // LINEAR_OBJECT_STORAGE_CACHE_H
@@ -2,8 +2,20 @@
 #include <vector>
 #include <chrono>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <cstdlib>
+
+#include "bench.hh"
 
 #include "linear_object_storage.hh"
+#include "concurrent_linear_object_storage.hh"
+#include "linear_object_storage_cache.hh"
+#include "chunked_linear_object_storage.hh"
+#include "object_pool.hh"
 
 /* config */
 #define BENCH_SHORT_ALLOC
@@ -41,83 +53,338 @@ int main()
 /////////////////////////////////// FULL BENCHMARK
 #else
 
-template<typename T>
-void shuffle_container(T & container)
+/* Benchmark object of a given size */
+template<std::size_t Size>
+struct object { unsigned char data[Size]; };
+
+/* Order in which a run allocates and frees its objects */
+enum class pattern { lifo, fifo, random, bursty };
+
+char const * pattern_name(pattern p)
+{
+    switch (p)
+    {
+    case pattern::lifo: return "lifo";
+    case pattern::fifo: return "fifo";
+    case pattern::random: return "random";
+    case pattern::bursty: return "bursty";
+    }
+    return "?";
+}
+
+/* One step of a pattern, allocate into or free object index */
+struct op
 {
-    std::random_device rd;
-    std::mt19937 g{rd()};
+    bool alloc;
+    std::uint32_t index;
+};
+
+/* Every object in [0, count) is allocated once and freed once */
+std::vector<op> make_ops(pattern p, std::size_t count, std::mt19937 & g)
+{
+    std::vector<op> ret;
+    ret.reserve(count * 2);
+
+    std::vector<std::uint32_t> order(count);
+    for (std::size_t i = 0; i < count; ++i)
+        order[i] = static_cast<std::uint32_t>(i);
+
+    switch (p)
+    {
+    case pattern::lifo:
+        for (auto i : order) ret.push_back({true, i});
+        for (auto i = order.rbegin(); i != order.rend(); ++i) ret.push_back({false, *i});
+        break;
+
+    case pattern::fifo:
+        for (auto i : order) ret.push_back({true, i});
+        for (auto i : order) ret.push_back({false, i});
+        break;
+
+    case pattern::random:
+        for (auto i : order) ret.push_back({true, i});
+        std::shuffle(order.begin(), order.end(), g);
+        for (auto i : order) ret.push_back({false, i});
+        break;
+
+    case pattern::bursty:
+    {
+        /* Bursts of allocations, each followed by freeing some random
+         * live objects, the rest go at the end */
+        std::vector<std::uint32_t> live;
+        std::size_t next = 0;
+
+        while (next < count)
+        {
+            auto burst = std::min(count - next, 1 + g() % std::max<std::size_t>(1, count / 4));
+            for (std::size_t i = 0; i < burst; ++i, ++next) {
+                ret.push_back({true, order[next]});
+                live.push_back(order[next]);
+            }
 
-    std::shuffle(container.begin(), container.end(), g);
+            std::shuffle(live.begin(), live.end(), g);
+            auto drop = g() % (live.size() + 1);
+            for (std::size_t i = 0; i < drop; ++i) {
+                ret.push_back({false, live.back()});
+                live.pop_back();
+            }
+        }
+
+        std::shuffle(live.begin(), live.end(), g);
+        for (auto i : live) ret.push_back({false, i});
+        break;
+    }
+    }
+
+    return ret;
 }
 
-#define TEST1(NAME, NUM, ALLOC, DEALLOC)                                              \
-    do {                                                                             \
-        auto start = std::chrono::steady_clock::now();                               \
-                                                                                     \
-        foo * foos[100] = {nullptr};                                                 \
-                                                                                     \
-        for (std::size_t i = 0 ; i < NUM; ++i)                                       \
-        {                                                                            \
-            shuffle_container(indices);                                              \
-            shuffle_container(indices2);                                             \
-            for (auto & j : indices) { foos[j] = (ALLOC); }                          \
-            for (auto & j : indices2) { (DEALLOC); }                                 \
-        }                                                                            \
-                                                                                     \
-        auto end = std::chrono::steady_clock::now();                                 \
-        auto res1 = std::chrono::duration <double, std::milli>(end-start).count();   \
-                                                                                     \
-        std::cout << NAME << " took " << (res1) << "ms" << std::endl;                \
-                                                                                     \
-    } while (0)
-
-
-int main(void)
+/* Times ALLOC/DEALLOC (with the object pointer in p) over every pattern */
+template<typename T, typename Alloc, typename Dealloc, typename Reset>
+void bench_patterns(bench::reporter & rep, std::string const & name, std::size_t count,
+                    Alloc alloc, Dealloc dealloc, Reset reset)
 {
-    /* Setup storage and indicies */
-    std::vector<std::size_t> indices;
-    std::vector<std::size_t> indices2;
-    indices.reserve(100);
-    indices2.reserve(100);
+    if (!rep.wanted(name))
+        return;
 
-    for (std::size_t i = 0; i < 100; ++i)
-        indices.push_back(i);
+    std::mt19937 g{std::random_device{}()};
+    std::vector<T *> objs(count, nullptr);
+    std::vector<op> ops;
 
-    indices2 = indices;
+    for (auto p : {pattern::lifo, pattern::fifo, pattern::random, pattern::bursty})
+    {
+        bench::params params{
+            {"size", std::to_string(sizeof(T))},
+            {"pool", std::to_string(count)},
+            {"pattern", pattern_name(p)},
+        };
 
-    /***** Allocators */
-    linear_object_storage<foo, 100> alloc;
+        /* Shuffling and resets stay out of the timed region */
+        auto setup = [&] { ops = make_ops(p, count, g); reset(); };
+        auto body = [&] {
+            for (auto const & o : ops)
+            {
+                if (o.alloc) {
+                    objs[o.index] = alloc();
+                    objs[o.index]->data[0] = static_cast<unsigned char>(o.index);
+                }
+                else
+                    dealloc(objs[o.index]);
+            }
+        };
 
-#ifdef BENCH_SHORT_ALLOC
-    arena<(sizeof(foo) * 100), alignof(foo)> ar{};
-    short_alloc<foo, (sizeof(foo) * 100), alignof(foo)> sa{ar};
-#endif
-    /*****************/
+        rep.add(bench::run(name, params, rep.opts(), count * 2, setup, body));
+    }
+}
+
+/* Every single threaded allocator for one object size and pool size */
+template<std::size_t Size, std::size_t Pool>
+void bench_allocators(bench::reporter & rep)
+{
+    using T = object<Size>;
+    auto no_reset = [] {};
+
+    /* Pools go on the heap, they get large */
+    auto search = std::unique_ptr<linear_object_storage<T, Pool>>{
+        new linear_object_storage<T, Pool>{}};
+    auto free_list = std::unique_ptr<linear_object_storage<T, Pool, true>>{
+        new linear_object_storage<T, Pool, true>{}};
+    chunked_linear_object_storage<T, 64> chunked{{false, false, 4}};
 
-    std::size_t test1_iters = 5000;
+    bench_patterns<T>(rep, "linear_object_storage", Pool,
+         [&] { return search->allocate(1); },
+         [&](T * p) { search->deallocate(p, 1); }, no_reset);
 
-    /* Tests */
-    TEST1("linear_object_storage", test1_iters,
-         (alloc.allocate(1)),
-         (alloc.deallocate(foos[j], 1))
-         );
+    bench_patterns<T>(rep, "linear_object_storage (free list)", Pool,
+         [&] { return free_list->allocate(1); },
+         [&](T * p) { free_list->deallocate(p, 1); }, no_reset);
 
-    TEST1("malloc", test1_iters,
-         (reinterpret_cast<foo *>(std::malloc(sizeof(foo)))),
-         (std::free(foos[j]))
-        );
+    bench_patterns<T>(rep, "chunked_linear_object_storage", Pool,
+         [&] { return chunked.allocate(1); },
+         [&](T * p) { chunked.deallocate(p, 1); }, no_reset);
 
-    TEST1("new", test1_iters,
-         (new foo{}),
-         (delete foos[j])
-        );
+    bench_patterns<T>(rep, "malloc", Pool,
+         [&] { return reinterpret_cast<T *>(std::malloc(sizeof(T))); },
+         [&](T * p) { std::free(p); }, no_reset);
+
+    bench_patterns<T>(rep, "new", Pool,
+         [&] { return new T{}; },
+         [&](T * p) { delete p; }, no_reset);
 
 #ifdef BENCH_SHORT_ALLOC
-    TEST1("short_alloc", test1_iters,
-         (sa.allocate(1)),
-         (sa.deallocate(foos[j], 1))
-        );
+    using arena_type = arena<(sizeof(T) * Pool), alignof(T)>;
+    auto ar = std::unique_ptr<arena_type>{new arena_type{}};
+    short_alloc<T, (sizeof(T) * Pool), alignof(T)> sa{*ar};
+
+    /* Non-LIFO frees leave the bump pointer behind, start each run clean */
+    bench_patterns<T>(rep, "short_alloc", Pool,
+         [&] { return sa.allocate(1); },
+         [&](T * p) { sa.deallocate(p, 1); },
+         [&] { ar->reset(); });
 #endif
+}
+
+/* Runs fn(thread_index) on num_threads threads */
+template<typename F>
+void run_threads(std::size_t num_threads, F fn)
+{
+    std::vector<std::thread> threads;
+
+    for (std::size_t t = 0; t < num_threads; ++t)
+        threads.emplace_back(fn, t);
+
+    for (auto & t : threads)
+        t.join();
+}
+
+/* Objects each thread holds at once in the multithreaded tests */
+constexpr std::size_t mt_outstanding = 16;
+/* Largest linear_object_storage_cache magazine tried */
+constexpr std::size_t mt_max_magazine = 64;
+/* Most a thread can take from the pool, its objects plus a full magazine */
+constexpr std::size_t mt_thread_slots = mt_outstanding + 2 * mt_max_magazine;
+/* Enough slots for every thread on a large box */
+constexpr std::size_t mt_slots = mt_thread_slots * 256;
+/* Alloc/free rounds per thread */
+constexpr std::size_t mt_iters = 5000;
+
+/* Every thread churns a handful of objects through a shared pool */
+template<typename Alloc, typename Dealloc>
+void bench_threads(bench::reporter & rep, std::string const & name, std::size_t threads,
+                   Alloc alloc, Dealloc dealloc)
+{
+    if (!rep.wanted(name))
+        return;
+
+    rep.add(bench::run(name, {{"threads", std::to_string(threads)}}, rep.opts(),
+                       threads * mt_iters * mt_outstanding * 2, [&] {
+        run_threads(threads, [&](std::size_t) {
+            foo * foos[mt_outstanding] = {nullptr};
+
+            for (std::size_t i = 0 ; i < mt_iters; ++i)
+            {
+                for (auto & p : foos) { p = alloc(); }
+                for (auto & p : foos) { dealloc(p); }
+            }
+        });
+    }));
+}
+
+
+int main(int argc, char ** argv)
+{
+    bench::reporter rep{bench::parse_args(argc, argv)};
+
+    /* Single threaded, object size x pool size x pattern */
+    bench_allocators<16, 100>(rep);
+    bench_allocators<16, 4096>(rep);
+    bench_allocators<256, 100>(rep);
+    bench_allocators<256, 4096>(rep);
+    bench_allocators<sizeof(foo), 100>(rep);
+    bench_allocators<sizeof(foo), 4096>(rep);
+
+    /* Constructing counterpart of new/delete */
+    if (rep.wanted("object_pool create/destroy (free list)"))
+    {
+        object_pool<linear_object_storage<foo, 100, true>> pool;
+        foo * foos[100] = {nullptr};
+
+        rep.add(bench::run("object_pool create/destroy (free list)", {{"pool", "100"}},
+                           rep.opts(), 200, [&] {
+            for (auto & p : foos) { p = pool.create(); }
+            for (auto & p : foos) { pool.destroy(p); }
+        }));
+    }
+
+    /* Batch allocations from a large, mostly full pool */
+    if (rep.wanted("linear_object_storage batch"))
+    {
+        constexpr std::size_t pool_slots = 1 << 16;
+        constexpr std::size_t batch = 16;
+        constexpr std::size_t rounds = 10000;
+        auto big = std::unique_ptr<linear_object_storage<std::uint64_t, pool_slots>>{
+            new linear_object_storage<std::uint64_t, pool_slots>{}};
+
+        /* Fill it, then punch a hole every so often near the end */
+        std::vector<std::uint64_t *> singles;
+        for (std::size_t i = 0; i < pool_slots; ++i)
+            singles.push_back(big->allocate(1));
+        for (std::size_t i = pool_slots - (pool_slots / 64); i < pool_slots; i += batch * 2)
+            for (std::size_t j = 0; j < batch; ++j)
+                big->deallocate(singles[i + j], 1);
+
+        rep.add(bench::run("linear_object_storage batch",
+                           {{"batch", std::to_string(batch)}, {"pool", std::to_string(pool_slots)}},
+                           rep.opts(), rounds * 2, [&] {
+            for (std::size_t i = 0; i < rounds; ++i)
+                big->deallocate(big->allocate(batch), batch);
+        }));
+    }
+
+    /* Shared pools, one to all cores */
+    {
+        auto concurrent = std::unique_ptr<concurrent_linear_object_storage<foo, mt_slots>>{
+            new concurrent_linear_object_storage<foo, mt_slots>{}};
+        auto locked = std::unique_ptr<linear_object_storage<foo, mt_slots, true>>{
+            new linear_object_storage<foo, mt_slots, true>{}};
+        std::mutex locked_mutex;
+
+        std::size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+        max_threads = std::min(max_threads, mt_slots / mt_thread_slots);
+
+        std::vector<std::size_t> thread_counts;
+        for (std::size_t threads = 1; threads < max_threads; threads *= 2)
+            thread_counts.push_back(threads);
+        thread_counts.push_back(max_threads);
+
+        for (auto threads : thread_counts)
+        {
+            bench_threads(rep, "concurrent_linear_object_storage", threads,
+                 [&] { return concurrent->allocate(1); },
+                 [&](foo * p) { concurrent->deallocate(p, 1); });
+
+            for (std::size_t magazine : {std::size_t{8}, mt_max_magazine})
+            {
+                auto name = "linear_object_storage_cache (magazine " + std::to_string(magazine) + ")";
+                if (!rep.wanted(name))
+                    continue;
+
+                std::vector<double> hit_rates(threads);
+
+                auto res = bench::run(name, {{"threads", std::to_string(threads)}}, rep.opts(),
+                                      threads * mt_iters * mt_outstanding * 2, [&] {
+                    run_threads(threads, [&](std::size_t t) {
+                        linear_object_storage_cache<concurrent_linear_object_storage<foo, mt_slots>>
+                            cache{*concurrent, magazine};
+                        foo * foos[mt_outstanding] = {nullptr};
+
+                        for (std::size_t i = 0 ; i < mt_iters; ++i)
+                        {
+                            for (auto & p : foos) { p = cache.allocate(1); }
+                            for (auto & p : foos) { cache.deallocate(p, 1); }
+                        }
+
+                        hit_rates[t] = cache.get_stats().hit_rate();
+                    });
+                });
+
+                /* Hit rates of the last run, one per thread */
+                for (std::size_t t = 0; t < threads; ++t)
+                    res.params.emplace_back("hit_rate_" + std::to_string(t), std::to_string(hit_rates[t]));
+
+                rep.add(std::move(res));
+            }
+
+            bench_threads(rep, "mutex + linear_object_storage (free list)", threads,
+                 [&] { std::lock_guard<std::mutex> lk{locked_mutex}; return locked->allocate(1); },
+                 [&](foo * p) { std::lock_guard<std::mutex> lk{locked_mutex}; locked->deallocate(p, 1); });
+
+            bench_threads(rep, "malloc", threads,
+                 [&] { return reinterpret_cast<foo *>(std::malloc(sizeof(foo))); },
+                 [&](foo * p) { std::free(p); });
+        }
+    }
 
+    rep.print(std::cout);
 }
 #endif
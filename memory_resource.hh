@@ -0,0 +1,154 @@
+#ifndef MEMORY_RESOURCE_H
+#define MEMORY_RESOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <new>
+
+#include "linear_object_storage.hh"
+#include "short_alloc.hh"
+
+/**
+ * std::pmr::memory_resource adapters for the fixed size allocators.
+ *
+ * short_alloc and linear_object_storage carry their sizes in the type, so two
+ * containers on different arenas are different types. Behind a
+ * memory_resource they are all std::pmr::vector / std::pmr::string and can be
+ * passed through non-template interfaces. The standard pool resources stack
+ * on top as usual:
+ *
+ *   arena<64 * 1024> a;
+ *   arena_resource<arena<64 * 1024>> r{a};
+ *   std::pmr::unsynchronized_pool_resource pool{&r};
+ *   std::pmr::vector<std::pmr::string> v{&pool};
+ */
+
+/**
+ * @brief memory_resource over an arena (arena, mmap_arena, slab_arena)
+ * @tparam Arena Arena type, used by reference and not owned
+ * @tparam Align Alignment every request is rounded to, at most the arena's
+ *
+ * The arena's overflow policy decides what happens when it is full. Requests
+ * aligned past Align (the standard pool resources ask for up to page
+ * aligned chunks) are over-allocated by the alignment and the offset back
+ * to the arena's block is kept just in front of the returned pointer.
+ */
+template<typename Arena, std::size_t Align = alignof(std::max_align_t)>
+class arena_resource : public std::pmr::memory_resource
+{
+private:
+    static_assert(Align >= sizeof(std::size_t), "Align must leave room for the offset");
+
+    Arena & m_arena;
+
+protected:
+    void * do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        if (alignment <= Align)
+            return m_arena.template allocate<Align>(bytes);
+
+        /* Blocks are Align aligned so the offset is at least Align */
+        auto * raw = m_arena.template allocate<Align>(bytes + alignment);
+        auto offset = alignment - reinterpret_cast<std::uintptr_t>(raw) % alignment;
+        auto * ret = raw + offset;
+        std::memcpy(ret - sizeof(offset), &offset, sizeof(offset));
+        return ret;
+    }
+
+    void do_deallocate(void * p, std::size_t bytes, std::size_t alignment) override
+    {
+        auto * c = static_cast<char *>(p);
+
+        if (alignment <= Align) {
+            m_arena.deallocate(c, bytes);
+            return;
+        }
+
+        std::size_t offset;
+        std::memcpy(&offset, c - sizeof(offset), sizeof(offset));
+        m_arena.deallocate(c - offset, bytes + alignment);
+    }
+
+    bool do_is_equal(std::pmr::memory_resource const & other) const noexcept override
+    {
+        return this == &other;
+    }
+
+public:
+    explicit arena_resource(Arena & a) noexcept :
+        m_arena{a}
+    {}
+
+    arena_resource(arena_resource const &) = delete;
+    arena_resource & operator=(arena_resource const &) = delete;
+
+    Arena & get_arena() const noexcept { return m_arena; }
+};
+
+/**
+ * @brief memory_resource handing out runs of linear_object_storage slots
+ * @tparam Storage A linear_object_storage, used by reference and not owned
+ *
+ * A request takes ceil(bytes / slot size) slots. Requests the storage can't
+ * serve go to the upstream resource: alignments past the slot's, more than
+ * one slot in free list mode, or a full storage. Pass
+ * std::pmr::null_memory_resource() to make those throw instead.
+ */
+template<typename Storage>
+class object_storage_resource : public std::pmr::memory_resource
+{
+private:
+    using slot = typename Storage::value_type;
+
+    Storage & m_storage;
+    std::pmr::memory_resource * m_upstream;
+
+    static std::size_t slots(std::size_t bytes)
+    {
+        return bytes ? (bytes + sizeof(slot) - 1) / sizeof(slot) : 1;
+    }
+
+protected:
+    void * do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        if (alignment <= alignof(slot)) {
+            try {
+                return m_storage.allocate(slots(bytes));
+            }
+            catch (std::bad_alloc const &) {
+            }
+        }
+
+        return m_upstream->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void * p, std::size_t bytes, std::size_t alignment) override
+    {
+        if (m_storage.owns(p))
+            m_storage.deallocate(static_cast<slot *>(p), slots(bytes));
+        else
+            m_upstream->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(std::pmr::memory_resource const & other) const noexcept override
+    {
+        return this == &other;
+    }
+
+public:
+    explicit object_storage_resource(Storage & s,
+                                     std::pmr::memory_resource * upstream = std::pmr::get_default_resource()) noexcept :
+        m_storage{s},
+        m_upstream{upstream}
+    {}
+
+    object_storage_resource(object_storage_resource const &) = delete;
+    object_storage_resource & operator=(object_storage_resource const &) = delete;
+
+    Storage & storage() const noexcept { return m_storage; }
+    std::pmr::memory_resource * upstream_resource() const noexcept { return m_upstream; }
+};
+
+#endif  // MEMORY_RESOURCE_H
@@ -0,0 +1,125 @@
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "alloc_counter.hh"
+#include "bench.hh"
+#include "linear_object_storage.hh"
+#include "memory_resource.hh"
+#include "short_alloc.hh"
+
+/* Buffer size for every resource, enough for one workload run */
+constexpr std::size_t buffer_bytes = 1 << 20;
+
+/* 64 byte slots, a run of them per string or vector buffer */
+struct slot { alignas(std::max_align_t) unsigned char data[64]; };
+using storage_type = linear_object_storage<slot, buffer_bytes / sizeof(slot)>;
+using arena_type = arena<buffer_bytes>;
+
+/**
+ * Not a template: anything behind a memory_resource goes through the same
+ * code, as it would across a module boundary
+ */
+std::size_t workload(std::pmr::memory_resource * r, std::mt19937 & g, std::size_t rounds)
+{
+    std::pmr::vector<std::pmr::string> v{r};
+    std::size_t total = 0;
+
+    for (std::size_t i = 0; i < rounds; ++i)
+    {
+        v.emplace_back(24 + g() % 64, 'x');
+        if (v.size() == 256) {
+            for (auto const & s : v)
+                total += s.size();
+            v.clear();
+        }
+    }
+
+    return total;
+}
+
+int main(int argc, char ** argv)
+{
+    bench::reporter rep{bench::parse_args(argc, argv)};
+    std::mt19937 g{std::random_device{}()};
+    constexpr std::size_t rounds = 4096;
+    volatile std::size_t sink = 0;
+
+    /* Times run_once with a fresh resource from make each run */
+    auto measure = [&](std::string const & name, auto make) {
+        if (!rep.wanted(name))
+            return;
+
+        std::size_t heap = 0;
+        decltype(make()) res;
+        auto r = bench::run(name, {}, rep.opts(), rounds, [&] {
+            res.reset();
+            res = make();
+        }, [&] {
+            auto before = heap_allocations;
+            sink = workload(res->get(), g, rounds);
+            heap += heap_allocations - before;
+        });
+        res.reset();
+
+        r.params.emplace_back("heap_allocs_per_run",
+                              std::to_string(heap / (rep.opts().runs + rep.opts().warmup)));
+        rep.add(std::move(r));
+    };
+
+    /* A resource stack, destroyed outermost first, so setup can rebuild it */
+    struct stack
+    {
+        std::unique_ptr<unsigned char[]> buffer;
+        std::unique_ptr<arena_type> a;
+        std::unique_ptr<storage_type> s;
+        std::unique_ptr<std::pmr::memory_resource> inner;
+        std::unique_ptr<std::pmr::memory_resource> outer;
+        std::pmr::memory_resource * top = nullptr;
+
+        std::pmr::memory_resource * get() const { return top ? top : outer ? outer.get() : inner.get(); }
+    };
+
+    measure("new_delete_resource", [] {
+        auto st = std::make_unique<stack>();
+        st->top = std::pmr::new_delete_resource();
+        return st;
+    });
+
+    measure("monotonic_buffer_resource", [] {
+        auto st = std::make_unique<stack>();
+        st->buffer.reset(new unsigned char[buffer_bytes]);
+        st->inner.reset(new std::pmr::monotonic_buffer_resource{st->buffer.get(), buffer_bytes,
+                                                                std::pmr::null_memory_resource()});
+        return st;
+    });
+
+    measure("arena_resource", [] {
+        auto st = std::make_unique<stack>();
+        st->a.reset(new arena_type{});
+        st->a->set_overflow(arena_overflow::throw_bad_alloc);
+        st->inner.reset(new arena_resource<arena_type>{*st->a});
+        return st;
+    });
+
+    measure("unsynchronized_pool_resource over arena_resource", [] {
+        auto st = std::make_unique<stack>();
+        st->a.reset(new arena_type{});
+        st->a->set_overflow(arena_overflow::throw_bad_alloc);
+        st->inner.reset(new arena_resource<arena_type>{*st->a});
+        st->outer.reset(new std::pmr::unsynchronized_pool_resource{st->inner.get()});
+        return st;
+    });
+
+    measure("object_storage_resource", [] {
+        auto st = std::make_unique<stack>();
+        st->s.reset(new storage_type{});
+        st->inner.reset(new object_storage_resource<storage_type>{*st->s, std::pmr::null_memory_resource()});
+        return st;
+    });
+
+    rep.print(std::cout);
+}
@@ -0,0 +1,143 @@
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "concurrent_linear_object_storage.hh"
+#include "wait_strategy.hh"
+
+/**
+ * @brief Fixed pool of messages handed through queues by owning handle
+ * @details Producers acquire a constructed message, push the handle through
+ *          a queue (mpmc_queue, spsc_queue, Queue) and whoever ends up with
+ *          it lets the handle go, which destroys the message and gives its
+ *          slot back. Nothing is copied and a slot can't be reused while a
+ *          reader still holds it.
+ *
+ *          When every slot is out, acquire() waits for a release with the
+ *          Wait strategy, so a slow reader throttles the writer instead of
+ *          the pool growing. Handles are std::unique_ptr, so a null handle
+ *          is the queues' terminator.
+ *
+ *          message_pool<foo, 1024> pool;
+ *          spsc_queue<message_pool<foo, 1024>::handle, 1024> q;
+ *          q.push(pool.acquire(1, 2));         // writer
+ *          while (auto m = q.wait_and_pop())   // reader
+ *              use(*m);
+ *
+ *          The pool must outlive every handle, queues included.
+ *
+ * @tparam T Message type
+ * @tparam N Number of messages that can be in flight
+ * @tparam Wait How acquire() waits for a free slot, see wait_strategy.hh
+ */
+template<typename T, std::size_t N, typename Wait = spin_then_park<>>
+class message_pool
+{
+public:
+    /* Gives the message back to its pool */
+    struct releaser
+    {
+        message_pool * pool = nullptr;
+
+        void operator()(T * p) const { pool->release(p); }
+    };
+
+    using handle = std::unique_ptr<T, releaser>;
+
+    struct stats
+    {
+        /* Messages out right now */
+        std::size_t in_use;
+        /* Most messages ever out at once */
+        std::size_t high_water;
+        std::size_t capacity;
+        /* Successful acquires */
+        std::size_t acquires;
+        /* acquire() calls that found the pool empty and had to wait */
+        std::size_t backpressure_waits;
+
+        double occupancy() const { return capacity ? static_cast<double>(in_use) / capacity : 0.0; }
+    };
+
+private:
+    static constexpr std::size_t cache_line = 64;
+
+    concurrent_linear_object_storage<T, N> m_storage;
+    /**< Writers waiting for a release */
+    alignas(cache_line) Wait m_room;
+    alignas(cache_line) std::atomic<std::size_t> m_acquires{0};
+    std::atomic<std::size_t> m_waits{0};
+
+    /* Constructs in a free slot, nullptr when there is none */
+    template<typename... Args>
+        T * try_create(Args &&... args)
+        {
+            std::uint32_t slot;
+            if (!m_storage.acquire_slots(&slot, 1))
+                return nullptr;
+
+            try {
+                auto * p = ::new(static_cast<void *>(m_storage.slot_address(slot)))
+                    T(std::forward<Args>(args)...);
+                m_acquires.fetch_add(1, std::memory_order_relaxed);
+                return p;
+            }
+            catch (...) {
+                m_storage.release_slots(&slot, 1);
+                throw;
+            }
+        }
+
+public:
+    message_pool() = default;
+    message_pool(message_pool const &) = delete;
+    message_pool& operator=(message_pool const &) = delete;
+
+    /* A message built from args, or a null handle when the pool is empty */
+    template<typename... Args>
+        handle try_acquire(Args &&... args)
+        {
+            return handle{try_create(std::forward<Args>(args)...), releaser{this}};
+        }
+
+    /* A message built from args, waits while the pool is empty */
+    template<typename... Args>
+        handle acquire(Args &&... args)
+        {
+            T * p = try_create(std::forward<Args>(args)...);
+
+            if (!p) {
+                m_waits.fetch_add(1, std::memory_order_relaxed);
+                m_room.wait([&] { return (p = try_create(std::forward<Args>(args)...)) != nullptr; });
+            }
+
+            return handle{p, releaser{this}};
+        }
+
+    /* Destroys a message from acquire() and frees its slot, handles call this */
+    void release(T * p)
+    {
+        auto slot = m_storage.slot_index(p);
+        p->~T();
+        m_storage.release_slots(&slot, 1);
+        m_room.notify_one();
+    }
+
+    stats get_stats() const
+    {
+        auto info = m_storage.get_info();
+        return stats{info.first, info.second, N,
+                     m_acquires.load(std::memory_order_relaxed),
+                     m_waits.load(std::memory_order_relaxed)};
+    }
+
+    static constexpr std::size_t capacity() { return N; }
+};
+
+#endif  // MESSAGE_POOL_H
@@ -0,0 +1,110 @@
+#ifndef MMAP_ARENA_H
+#define MMAP_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "short_alloc.hh"
+
+// Arena over a runtime-sized mmap region, for large per-thread scratch
+// space that shouldn't sit on the stack or burn TLB entries.
+//
+// With huge_pages the region is first requested with MAP_HUGETLB (rounded
+// up to 2MB), and if the system has no huge pages reserved it falls back to
+// a normal mapping advised with MADV_HUGEPAGE so transparent huge pages can
+// back it.
+//
+//   mmap_arena<64> a{64 << 20, true};
+//   std::vector<float, mmap_alloc<float, 64>> v{a};
+
+// Owns the mapping, a base of mmap_arena so it exists before arena_base
+class mmap_region
+{
+    static constexpr std::size_t huge_page = 2 * 1024 * 1024;
+
+    void* map_;
+    std::size_t map_len_;
+    bool huge_;
+    char* buf_;
+    std::size_t usable_;
+
+public:
+    // Maps at least n usable bytes aligned to alignment
+    mmap_region(std::size_t n, std::size_t alignment, bool huge_pages)
+        : map_(MAP_FAILED), map_len_(0), huge_(false)
+    {
+        auto const page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        // Page alignment comes free, anything past it needs slack
+        auto const slack = alignment > page ? alignment : 0;
+
+#ifdef MAP_HUGETLB
+        if (huge_pages)
+        {
+            map_len_ = (n + slack + huge_page - 1) & ~(huge_page - 1);
+            map_ = ::mmap(nullptr, map_len_, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            huge_ = map_ != MAP_FAILED;
+        }
+#endif
+
+        if (map_ == MAP_FAILED)
+        {
+            map_len_ = (n + slack + page - 1) & ~(page - 1);
+            map_ = ::mmap(nullptr, map_len_, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        }
+
+        if (map_ == MAP_FAILED)
+            throw std::bad_alloc{};
+
+#ifdef MADV_HUGEPAGE
+        if (huge_pages && !huge_)
+            ::madvise(map_, map_len_, MADV_HUGEPAGE);
+#endif
+
+        auto const begin = reinterpret_cast<std::uintptr_t>(map_);
+        auto const buf = (begin + alignment - 1) & ~(alignment - 1);
+        buf_ = reinterpret_cast<char*>(buf);
+        usable_ = (map_len_ - (buf - begin)) & ~(alignment - 1);
+    }
+
+    ~mmap_region() {::munmap(map_, map_len_);}
+    mmap_region(const mmap_region&) = delete;
+    mmap_region& operator=(const mmap_region&) = delete;
+
+    char* buffer() const noexcept {return buf_;}
+    std::size_t usable() const noexcept {return usable_;}
+    bool huge() const noexcept {return huge_;}
+};
+
+template <std::size_t alignment = alignof(std::max_align_t)>
+class mmap_arena
+    : private mmap_region
+    , public arena_base<alignment>
+{
+public:
+    // Throws std::bad_alloc if the mapping fails
+    explicit mmap_arena(std::size_t n, bool huge_pages = false)
+        : mmap_region(n, alignment, huge_pages)
+        , arena_base<alignment>(buffer(), usable())
+    {}
+
+    // At least what was asked for, rounded up to whole pages
+    std::size_t size() const noexcept {return usable();}
+
+    // Whether MAP_HUGETLB worked
+    bool huge_pages() const noexcept {return huge();}
+};
+
+// short_alloc names arenas by <size, alignment>, the size is a runtime value here
+template <std::size_t, std::size_t alignment>
+using runtime_mmap_arena = mmap_arena<alignment>;
+
+template <class T, std::size_t Align = alignof(std::max_align_t)>
+using mmap_alloc = short_alloc<T, 0, Align, runtime_mmap_arena>;
+
+#endif  // MMAP_ARENA_H
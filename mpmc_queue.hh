@@ -0,0 +1,189 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "wait_strategy.hh"
+
+/**
+ * @brief Bounded lock-free multi producer multi consumer queue
+ * @tparam T Element type, constructible from nullptr for terminate()
+ * @tparam Capacity Number of slots, a power of two
+ * @tparam Wait How an empty or full ring is waited on, see wait_strategy.hh
+ * @details Same surface as Queue but a fixed ring of slots, each with its
+ *          own sequence number (Vyukov's design). A producer claims a slot
+ *          by advancing the enqueue position with a CAS once the slot's
+ *          sequence says it is empty for this lap, writes the value, then
+ *          publishes it by bumping the sequence. Consumers do the mirror
+ *          image. Slots and both positions sit on their own cache lines so
+ *          producers and consumers don't false share.
+ *
+ *          push() and wait_and_pop() wait on a full or empty ring with the
+ *          Wait strategy, spinning with a pause and then yielding by
+ *          default.
+ */
+template<typename T, std::size_t Capacity, typename Wait = spin_then_yield>
+class mpmc_queue final
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+public:
+    /**< Underlaying type */
+    using type = T;
+    /**< Queue type */
+    using data_type = T;
+    /**< Termination type */
+    using terminator = std::nullptr_t;
+
+private:
+    static constexpr std::size_t cache_line = 64;
+    static constexpr std::size_t mask = Capacity - 1;
+
+    struct alignas(cache_line) cell
+    {
+        /**< pos when free for the producer at pos, pos + 1 when filled */
+        std::atomic<std::size_t> sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    /**< Next position to push to */
+    alignas(cache_line) std::atomic<std::size_t> enqueue_pos;
+    /**< Next position to pop from */
+    alignas(cache_line) std::atomic<std::size_t> dequeue_pos;
+    /**< Consumers waiting for items, producers waiting for room */
+    alignas(cache_line) Wait m_not_empty;
+    alignas(cache_line) Wait m_not_full;
+    /**< The ring */
+    cell cells[Capacity];
+
+    template<typename U>
+    bool try_emplace(U && value)
+    {
+        auto pos = enqueue_pos.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            auto & c = cells[pos & mask];
+            auto seq = c.sequence.load(std::memory_order_acquire);
+            auto dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+
+            if (dif == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return false;   // full, the slot still holds last lap's value
+            else
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+
+        auto & c = cells[pos & mask];
+        new (&c.storage) T(std::forward<U>(value));
+        c.sequence.store(pos + 1, std::memory_order_release);
+        m_not_empty.notify_one();
+        return true;
+    }
+
+public:
+    mpmc_queue()
+    {
+        for (std::size_t i = 0; i < Capacity; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+
+        enqueue_pos.store(0, std::memory_order_relaxed);
+        dequeue_pos.store(0, std::memory_order_relaxed);
+    }
+
+    mpmc_queue(mpmc_queue const &) = delete;
+    mpmc_queue & operator=(mpmc_queue const &) = delete;
+
+    ~mpmc_queue()
+    {
+        T value = terminator();
+        while (try_pop(value))
+            ;
+    }
+
+    /**
+     * @brief Pushes without waiting
+     * @return false when the ring is full, value is left untouched (it is
+     *          only moved from once a slot is claimed)
+     */
+    bool try_push(T const & value) { return try_emplace(value); }
+    bool try_push(T && value) { return try_emplace(std::move(value)); }
+
+    /**
+     * @brief Pops without waiting
+     * @return false when the ring is empty
+     */
+    bool try_pop(T & value)
+    {
+        auto pos = dequeue_pos.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            auto & c = cells[pos & mask];
+            auto seq = c.sequence.load(std::memory_order_acquire);
+            auto dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+
+            if (dif == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return false;   // empty, nobody has filled this lap yet
+            else
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+        }
+
+        auto & c = cells[pos & mask];
+        auto * p = reinterpret_cast<T *>(&c.storage);
+        value = std::move(*p);
+        p->~T();
+        /* Free for the producer one lap ahead */
+        c.sequence.store(pos + Capacity, std::memory_order_release);
+        m_not_full.notify_one();
+        return true;
+    }
+
+    /* Queue's interface, nullptr when empty */
+    data_type try_pop()
+    {
+        data_type value = terminator();
+        try_pop(value);
+        return value;
+    }
+
+    data_type wait_and_pop()
+    {
+        data_type value = terminator();
+        m_not_empty.wait([&] { return try_pop(value); });
+        return value;
+    }
+
+    /* Waits for room when the ring is full */
+    void push(T new_value)
+    {
+        m_not_full.wait([&] { return try_emplace(std::move(new_value)); });
+    }
+
+    void terminate() { push(terminator()); }
+
+    /* Approximate while producers or consumers are running */
+    std::size_t size() const
+    {
+        auto tail = dequeue_pos.load(std::memory_order_acquire);
+        auto head = enqueue_pos.load(std::memory_order_acquire);
+        return head > tail ? head - tail : 0;
+    }
+
+    static constexpr std::size_t capacity() { return Capacity; }
+};
+
+#endif  // MPMC_QUEUE_H
@@ -0,0 +1,67 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <new>
+#include <utility>
+
+/**
+ * @brief Constructs objects in place in memory from a raw storage allocator
+ * @details The storages (linear_object_storage and friends) only hand out
+ *          uninitialized slots so they can back std containers. This adds
+ *          the object pool half on top: create constructs with the given
+ *          arguments, destroy destructs and gives the slot back.
+ *
+ *          object_pool<linear_object_storage<foo, 100, true>> pool;
+ *          foo * f = pool.create(1, 2);
+ *          pool.destroy(f);
+ *
+ * @tparam Storage Allocator handing out single slots
+ */
+template<typename Storage>
+class object_pool
+{
+public:
+    /* alias */
+    using storage_type = Storage;
+    using value_type = typename Storage::value_type;
+
+private:
+    using T = value_type;
+
+    storage_type m_storage;
+
+public:
+    /* Arguments are passed on to the storage */
+    template<typename... Args>
+        explicit object_pool(Args &&... args) :
+            m_storage(std::forward<Args>(args)...)
+        {}
+
+    object_pool(object_pool const &) = delete;
+    object_pool& operator=(object_pool const &) = delete;
+
+    storage_type & storage() { return m_storage; }
+    storage_type const & storage() const { return m_storage; }
+
+    template<typename... Args>
+        T * create(Args &&... args)
+        {
+            auto * p = m_storage.allocate(1);
+
+            try {
+                return ::new(static_cast<void *>(p)) T(std::forward<Args>(args)...);
+            }
+            catch (...) {
+                m_storage.deallocate(p, 1);
+                throw;
+            }
+        }
+
+    void destroy(T * p)
+    {
+        p->~T();
+        m_storage.deallocate(p, 1);
+    }
+};
+
+#endif  // OBJECT_POOL_H
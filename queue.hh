@@ -0,0 +1,98 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <queue>
+
+/* simple locking queue */
+template<typename T>
+class Queue final
+{
+public:
+    /**< Underlaying type */
+    using type = T;
+    /**< Queue type */
+    using data_type = T;
+    /**< Termination type */
+    using terminator = std::nullptr_t;
+
+private:
+    /**< Underlaying queue */
+    std::queue<data_type> data_queue;
+    /**< Mutex (mutable since empty() is const */
+    mutable std::mutex mutex;
+    /**< Condition variable */
+    std::condition_variable condition;
+
+public:
+    Queue() = default;
+
+    data_type wait_and_pop()
+    {
+        std::unique_lock<std::mutex> lk{mutex};
+        condition.wait(lk, [this] { return !data_queue.empty(); });
+        data_type value = std::move(data_queue.front());
+        data_queue.pop();
+        return value;
+    }
+
+    data_type try_pop()
+    {
+        std::lock_guard<std::mutex> lk{mutex};
+        if (data_queue.empty()) return nullptr;
+        data_type value = std::move(data_queue.front());
+        data_queue.pop();
+        return value;
+    }
+
+    void push(T new_value)
+    {
+        { // scope
+            /* Copy/move construct T TODO does this work ?!*/
+            data_type data = new_value;
+            std::lock_guard<std::mutex> lk{mutex};
+            data_queue.push(std::move(data));
+        }
+
+        condition.notify_one();
+    }
+
+    void terminate() { push(terminator()); }
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lk{mutex};
+        return data_queue.size();
+    }
+
+private:
+    /**
+     * @brief Determines in the underlaying queue is empty
+     * @return Empty status
+     */
+    bool empty() const
+    {
+        std::lock_guard<std::mutex> lk{mutex};
+        return data_queue.empty();
+    }
+
+    /**
+     * @brief Termination push
+     * @param term Terminator type to tell the queue to stop
+     */
+    void push(terminator term)
+    { 
+        /* should be convertible to our data_type */
+        data_type data = term;
+
+        { // scope
+            std::lock_guard<std::mutex> lk{mutex};
+            data_queue.push(std::move(data));
+        }
+
+        condition.notify_one();
+    }
+};
+
+#endif  // QUEUE_H
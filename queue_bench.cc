@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "bench.hh"
+#include "message_pool.hh"
+#include "mpmc_queue.hh"
+#include "queue.hh"
+#include "queue_stats.hh"
+#include "spsc_queue.hh"
+#include "wait_strategy.hh"
+
+/**
+ * Producer/consumer throughput and latency of the queues.
+ *
+ * Every producer pushes its own preallocated messages stamped with the push
+ * time, consumers pop until they see a terminator. Throughput is messages
+ * per run, latency is push to pop of each message in the last run.
+ */
+
+struct message
+{
+    std::uint64_t pushed_ns;
+};
+
+/* Messages per producer per run */
+constexpr std::size_t messages = 50000;
+
+std::uint64_t now_ns()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/* One item at a time */
+struct single
+{
+    template<typename Q>
+    static void produce(Q & q, std::vector<message> & msgs)
+    {
+        for (auto & m : msgs) {
+            m.pushed_ns = now_ns();
+            q.push(&m);
+        }
+    }
+
+    template<typename Q>
+    static void consume(Q & q, std::vector<double> & latency)
+    {
+        while (message * m = q.wait_and_pop())
+            latency.push_back(static_cast<double>(now_ns() - m->pushed_ns));
+    }
+};
+
+/* One item every GapNs, a moderately loaded pipeline where consumers idle.
+ * The producer sleeps between items so it leaves the core to consumers */
+template<std::uint64_t GapNs>
+struct paced
+{
+    template<typename Q>
+    static void produce(Q & q, std::vector<message> & msgs)
+    {
+        auto next = std::chrono::steady_clock::now();
+        for (auto & m : msgs) {
+            next += std::chrono::nanoseconds{GapNs};
+            std::this_thread::sleep_until(next);
+            m.pushed_ns = now_ns();
+            q.push(&m);
+        }
+    }
+
+    template<typename Q>
+    static void consume(Q & q, std::vector<double> & latency)
+    {
+        single::consume(q, latency);
+    }
+};
+
+/* push_n/pop_n in batches of up to K */
+template<std::size_t K>
+struct batched
+{
+    template<typename Q>
+    static void produce(Q & q, std::vector<message> & msgs)
+    {
+        message * batch[K];
+
+        for (std::size_t i = 0; i < msgs.size(); i += K)
+        {
+            auto n = std::min(K, msgs.size() - i);
+            for (std::size_t j = 0; j < n; ++j) {
+                batch[j] = &msgs[i + j];
+                batch[j]->pushed_ns = now_ns();
+            }
+
+            backoff b;
+            for (std::size_t done = 0; done < n; b.pause())
+                done += q.push_n(batch + done, n - done);
+        }
+    }
+
+    template<typename Q>
+    static void consume(Q & q, std::vector<double> & latency)
+    {
+        message * batch[K];
+        backoff b;
+
+        for (;;)
+        {
+            auto n = q.pop_n(batch, K);
+            if (n == 0) {
+                b.pause();
+                continue;
+            }
+            b.reset();
+
+            auto now = now_ns();
+            for (std::size_t i = 0; i < n; ++i) {
+                if (!batch[i])
+                    return;
+                latency.push_back(static_cast<double>(now - batch[i]->pushed_ns));
+            }
+        }
+    }
+};
+
+/* Push to pop latency percentiles and a histogram with 4x wider buckets */
+void add_latency(bench::result & r, std::vector<double> const & latency)
+{
+    r.params.emplace_back("lat_p50_ns", std::to_string(bench::percentile(latency, 50)));
+    r.params.emplace_back("lat_p99_ns", std::to_string(bench::percentile(latency, 99)));
+    r.params.emplace_back("lat_p999_ns", std::to_string(bench::percentile(latency, 99.9)));
+
+    static char const * const names[] = {"le_1us", "le_4us", "le_16us", "le_64us", "le_256us", "le_1ms", "gt_1ms"};
+    constexpr std::size_t buckets = sizeof(names) / sizeof(names[0]);
+    std::size_t counts[buckets] = {0};
+
+    for (auto ns : latency)
+    {
+        std::size_t b = 0;
+        for (double limit = 1000; b < buckets - 1 && ns > limit; limit *= 4)
+            ++b;
+        ++counts[b];
+    }
+
+    for (std::size_t b = 0; b < buckets; ++b)
+        r.params.emplace_back(names[b], std::to_string(counts[b]));
+}
+
+template<typename Q, typename Mode = single>
+void bench_queue(bench::reporter & rep, std::string const & name,
+                 std::size_t producers, std::size_t consumers,
+                 std::size_t count = messages)
+{
+    if (!rep.wanted(name))
+        return;
+
+    auto q = std::unique_ptr<Q>{new Q{}};
+    std::vector<std::vector<message>> sent(producers, std::vector<message>(count));
+    std::vector<std::vector<double>> latency(consumers);
+    /* Summed over every producer and consumer thread of a run */
+    std::vector<bench::counters> thread_counts(producers + consumers);
+
+    /* bench::run only counts its own thread */
+    auto counted = [&](std::size_t t, auto fn) {
+        bench::perf_counters perf;
+        perf.start();
+        fn();
+        thread_counts[t] = perf.stop();
+    };
+
+    auto r = bench::run(name, {{"producers", std::to_string(producers)},
+                               {"consumers", std::to_string(consumers)}},
+                        rep.opts(), producers * count, [&] {
+        for (auto & l : latency) {
+            l.clear();
+            l.reserve(producers * count / consumers + 1);
+        }
+    }, [&] {
+        std::vector<std::thread> threads;
+
+        for (std::size_t c = 0; c < consumers; ++c)
+            threads.emplace_back([&, c] {
+                counted(producers + c, [&] { Mode::consume(*q, latency[c]); });
+            });
+
+        std::vector<std::thread> writers;
+        for (std::size_t p = 0; p < producers; ++p)
+            writers.emplace_back([&, p] {
+                counted(p, [&] { Mode::produce(*q, sent[p]); });
+            });
+
+        for (auto & t : writers)
+            t.join();
+        for (std::size_t c = 0; c < consumers; ++c)
+            q->terminate();
+        for (auto & t : threads)
+            t.join();
+    });
+
+    std::vector<double> all;
+    for (auto const & l : latency)
+        all.insert(all.end(), l.begin(), l.end());
+
+    r.params.emplace_back("mops_per_s", std::to_string(r.ops / r.median_ns * 1000.0));
+    add_latency(r, all);
+
+    /* Last run's counters across the threads, per item */
+    if (thread_counts.front().valid) {
+        double misses = 0, cycles = 0;
+        for (auto const & c : thread_counts) {
+            misses += c.cache_misses;
+            cycles += c.cycles;
+        }
+        r.params.emplace_back("cache_misses_per_item", std::to_string(misses / r.ops));
+        r.params.emplace_back("cycles_per_item", std::to_string(cycles / r.ops));
+    }
+
+    rep.add(std::move(r));
+}
+
+/**
+ * Zero-copy pipeline: messages come from a pool smaller than the queue, so
+ * the producer is throttled by the consumer handing them back
+ */
+template<std::size_t PoolSize>
+void bench_pipeline(bench::reporter & rep, std::string const & name)
+{
+    if (!rep.wanted(name))
+        return;
+
+    using pool_type = message_pool<message, PoolSize>;
+    auto pool = std::unique_ptr<pool_type>{new pool_type{}};
+    auto q = std::unique_ptr<spsc_queue<typename pool_type::handle, 1024>>{
+        new spsc_queue<typename pool_type::handle, 1024>{}};
+    std::vector<double> latency;
+
+    auto r = bench::run(name, {{"pool", std::to_string(PoolSize)}}, rep.opts(), messages, [&] {
+        latency.clear();
+        latency.reserve(messages);
+    }, [&] {
+        std::thread consumer{[&] {
+            while (auto m = q->wait_and_pop())
+                latency.push_back(static_cast<double>(now_ns() - m->pushed_ns));
+        }};
+
+        for (std::size_t i = 0; i < messages; ++i)
+            q->push(pool->acquire(message{now_ns()}));
+
+        q->terminate();
+        consumer.join();
+    });
+
+    auto stats = pool->get_stats();
+    r.params.emplace_back("mops_per_s", std::to_string(r.ops / r.median_ns * 1000.0));
+    r.params.emplace_back("pool_high_water", std::to_string(stats.high_water));
+    r.params.emplace_back("backpressure_waits", std::to_string(stats.backpressure_waits));
+    add_latency(r, latency);
+    rep.add(std::move(r));
+}
+
+int main(int argc, char ** argv)
+{
+    bench::reporter rep{bench::parse_args(argc, argv)};
+
+    std::vector<std::pair<std::size_t, std::size_t>> shapes = {
+        {1, 1}, {1, 4}, {4, 1}, {2, 2}, {4, 4},
+    };
+
+    for (auto const & s : shapes)
+    {
+        bench_queue<Queue<message *>>(rep, "Queue (mutex)", s.first, s.second);
+        bench_queue<mpmc_queue<message *, 1024>>(rep, "mpmc_queue<1024>", s.first, s.second);
+    }
+
+    /* Single writer, single reader pipelines */
+    bench_queue<spsc_queue<message *, 1024>>(rep, "spsc_queue<1024>", 1, 1);
+    bench_queue<spsc_queue<message *, 1024>, batched<16>>(rep, "spsc_queue<1024> push_n/pop_n 16", 1, 1);
+    bench_queue<spsc_queue<message *, 1024>, batched<64>>(rep, "spsc_queue<1024> push_n/pop_n 64", 1, 1);
+
+    /* Cost of queue_stats, same queues with counters and one in 64 items timed */
+    bench_queue<instrumented_queue<spsc_queue<stamped<message *>, 1024>>>(rep, "instrumented spsc_queue<1024>", 1, 1);
+    bench_queue<instrumented_queue<mpmc_queue<stamped<message *>, 1024>>>(rep, "instrumented mpmc_queue<1024>", 1, 1);
+    bench_queue<instrumented_queue<mpmc_queue<stamped<message *>, 1024>>>(rep, "instrumented mpmc_queue<1024>", 4, 4);
+
+    /* Pooled messages with backpressure */
+    bench_pipeline<64>(rep, "message_pool + spsc_queue");
+    bench_pipeline<4096>(rep, "message_pool + spsc_queue");
+
+    /* Wait strategies under moderate load, one message every 50us */
+    constexpr std::uint64_t gap_ns = 50000;
+    constexpr std::size_t paced_messages = 1000;
+    using load = paced<gap_ns>;
+
+    bench_queue<Queue<message *>, load>(rep, "paced Queue (mutex)", 1, 1, paced_messages);
+
+    /* A spinning consumer starves the producer without a core of its own */
+    if (std::thread::hardware_concurrency() >= 2) {
+        bench_queue<mpmc_queue<message *, 1024, busy_spin>, load>(rep, "paced mpmc_queue busy_spin", 1, 1, paced_messages);
+        bench_queue<spsc_queue<message *, 1024, busy_spin>, load>(rep, "paced spsc_queue busy_spin", 1, 1, paced_messages);
+    }
+
+    bench_queue<mpmc_queue<message *, 1024, spin_then_yield>, load>(rep, "paced mpmc_queue spin_then_yield", 1, 1, paced_messages);
+    bench_queue<mpmc_queue<message *, 1024, spin_then_park<>>, load>(rep, "paced mpmc_queue spin_then_park", 1, 1, paced_messages);
+    bench_queue<mpmc_queue<message *, 1024, blocking>, load>(rep, "paced mpmc_queue blocking", 1, 1, paced_messages);
+    bench_queue<spsc_queue<message *, 1024, spin_then_yield>, load>(rep, "paced spsc_queue spin_then_yield", 1, 1, paced_messages);
+    bench_queue<spsc_queue<message *, 1024, spin_then_park<>>, load>(rep, "paced spsc_queue spin_then_park", 1, 1, paced_messages);
+    bench_queue<spsc_queue<message *, 1024, blocking>, load>(rep, "paced spsc_queue blocking", 1, 1, paced_messages);
+
+    rep.print(std::cout);
+}
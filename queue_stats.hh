@@ -0,0 +1,276 @@
+#ifndef QUEUE_STATS_H
+#define QUEUE_STATS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+/**
+ * @brief Log-linear histogram of nanosecond values with lock-free recording
+ * @details HDR style: every power of two range is split into 8 linear
+ *          sub-buckets, so any value is kept to within 12.5% over the full
+ *          64 bit range in a fixed 496 counters. record() is one relaxed
+ *          increment, any thread may read counts while others record.
+ */
+class latency_histogram
+{
+public:
+    static constexpr unsigned sub_bits = 3;
+    static constexpr std::size_t sub_buckets = std::size_t{1} << sub_bits;
+    static constexpr std::size_t num_buckets = (64 - sub_bits + 1) * sub_buckets;
+
+    using counts_type = std::array<std::uint64_t, num_buckets>;
+
+private:
+    std::array<std::atomic<std::uint64_t>, num_buckets> m_counts;
+
+public:
+    latency_histogram()
+    {
+        reset();
+    }
+
+    latency_histogram(latency_histogram const &) = delete;
+    latency_histogram& operator=(latency_histogram const &) = delete;
+
+    static std::size_t bucket(std::uint64_t v)
+    {
+        if (v < sub_buckets)
+            return static_cast<std::size_t>(v);
+
+        unsigned e = 63 - static_cast<unsigned>(__builtin_clzll(v));
+        auto sub = (v >> (e - sub_bits)) & (sub_buckets - 1);
+        return (e - sub_bits + 1) * sub_buckets + static_cast<std::size_t>(sub);
+    }
+
+    /* Largest value that lands in bucket i */
+    static std::uint64_t bucket_limit(std::size_t i)
+    {
+        if (i < sub_buckets)
+            return i;
+
+        auto e = i / sub_buckets + sub_bits - 1;
+        auto sub = i % sub_buckets;
+        auto low = (sub_buckets + sub) << (e - sub_bits);
+        return low + (std::uint64_t{1} << (e - sub_bits)) - 1;
+    }
+
+    void record(std::uint64_t ns)
+    {
+        m_counts[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void reset()
+    {
+        for (auto & c : m_counts)
+            c.store(0, std::memory_order_relaxed);
+    }
+
+    counts_type counts() const
+    {
+        counts_type ret;
+        for (std::size_t i = 0; i < num_buckets; ++i)
+            ret[i] = m_counts[i].load(std::memory_order_relaxed);
+        return ret;
+    }
+
+    /* pct in [0, 100], upper bound of the bucket holding that rank */
+    static std::uint64_t percentile(counts_type const & counts, double pct)
+    {
+        std::uint64_t total = 0;
+        for (auto c : counts)
+            total += c;
+        if (total == 0)
+            return 0;
+
+        auto rank = static_cast<std::uint64_t>(pct / 100.0 * static_cast<double>(total - 1) + 0.5) + 1;
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < num_buckets; ++i) {
+            seen += counts[i];
+            if (seen >= rank)
+                return bucket_limit(i);
+        }
+        return bucket_limit(num_buckets - 1);
+    }
+};
+
+/* What a queue has done so far, see queue_stats::snapshot() */
+struct queue_snapshot
+{
+    std::uint64_t enqueued = 0;
+    std::uint64_t dequeued = 0;
+    /* Deepest the queue has been */
+    std::uint64_t high_water = 0;
+    /* Items whose time in the queue was sampled */
+    std::uint64_t sampled = 0;
+    latency_histogram::counts_type sojourn_ns{};
+
+    /* Items in the queue when the snapshot was taken, roughly */
+    std::uint64_t depth() const { return enqueued > dequeued ? enqueued - dequeued : 0; }
+
+    std::uint64_t sojourn_percentile(double pct) const
+    {
+        return latency_histogram::percentile(sojourn_ns, pct);
+    }
+};
+
+/**
+ * @brief Counters for one queue, updated lock-free by producers and
+ *          consumers and readable from any thread
+ * @details Producers and consumers each bump a counter on their own cache
+ *          line. The depth seen by a producer after its push feeds the
+ *          high-water mark, one in sample_period items carries an enqueue
+ *          timestamp and its time in the queue goes into the histogram.
+ */
+class queue_stats
+{
+private:
+    static constexpr std::size_t cache_line = 64;
+
+    alignas(cache_line) std::atomic<std::uint64_t> m_enqueued{0};
+    alignas(cache_line) std::atomic<std::uint64_t> m_dequeued{0};
+    alignas(cache_line) std::atomic<std::uint64_t> m_high_water{0};
+    std::atomic<std::uint64_t> m_sampled{0};
+    std::uint64_t m_sample_mask;
+    latency_histogram m_sojourn;
+
+public:
+    /* sample_period is rounded down to a power of two, 1 samples everything */
+    explicit queue_stats(std::uint64_t sample_period = 64)
+    {
+        std::uint64_t p = 1;
+        while (p * 2 <= sample_period)
+            p *= 2;
+        m_sample_mask = p - 1;
+    }
+
+    queue_stats(queue_stats const &) = delete;
+    queue_stats& operator=(queue_stats const &) = delete;
+
+    static std::uint64_t now_ns()
+    {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    /**
+     * @brief Counts a push
+     * @return Timestamp to carry with the item, 0 when it isn't sampled
+     */
+    std::uint64_t on_push()
+    {
+        auto n = m_enqueued.fetch_add(1, std::memory_order_relaxed) + 1;
+        auto depth = n - std::min(n, m_dequeued.load(std::memory_order_relaxed));
+
+        auto high = m_high_water.load(std::memory_order_relaxed);
+        while (depth > high &&
+               !m_high_water.compare_exchange_weak(high, depth, std::memory_order_relaxed))
+            ;
+
+        return (n & m_sample_mask) == 0 ? now_ns() : 0;
+    }
+
+    /* Counts a pop of an item pushed with stamp from on_push() */
+    void on_pop(std::uint64_t stamp)
+    {
+        m_dequeued.fetch_add(1, std::memory_order_relaxed);
+
+        if (stamp) {
+            m_sojourn.record(now_ns() - stamp);
+            m_sampled.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /* Items in the queue right now, roughly, without copying the histogram */
+    std::uint64_t depth() const
+    {
+        /* Dequeues first so it doesn't go negative */
+        auto dequeued = m_dequeued.load(std::memory_order_relaxed);
+        auto enqueued = m_enqueued.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    queue_snapshot snapshot() const
+    {
+        queue_snapshot s;
+        /* Dequeues first so depth doesn't go negative */
+        s.dequeued = m_dequeued.load(std::memory_order_relaxed);
+        s.enqueued = m_enqueued.load(std::memory_order_relaxed);
+        s.high_water = m_high_water.load(std::memory_order_relaxed);
+        s.sampled = m_sampled.load(std::memory_order_relaxed);
+        s.sojourn_ns = m_sojourn.counts();
+        return s;
+    }
+};
+
+/**
+ * @brief Queue element carrying its enqueue timestamp, for instrumented_queue
+ */
+template<typename T>
+struct stamped
+{
+    T value;
+    std::uint64_t stamp_ns;
+
+    stamped(std::nullptr_t = nullptr) : value(nullptr), stamp_ns(0) {}
+    stamped(T v, std::uint64_t s) : value(std::move(v)), stamp_ns(s) {}
+};
+
+/**
+ * @brief Any of the queues with queue_stats on every push and pop
+ * @details Q holds stamped<T>, the wrapper has Q's push / try_pop /
+ *          wait_and_pop / terminate surface in terms of T. Terminators
+ *          aren't counted.
+ *
+ *          instrumented_queue<spsc_queue<stamped<foo *>, 1024>> q;
+ *          q.push(p);
+ *          auto s = q.stats().snapshot();  // from any thread
+ */
+template<typename Q>
+class instrumented_queue final
+{
+public:
+    using stamped_type = typename Q::data_type;
+    using data_type = decltype(std::declval<stamped_type>().value);
+    using type = data_type;
+    using terminator = std::nullptr_t;
+
+private:
+    Q m_queue;
+    queue_stats m_stats;
+
+    data_type unwrap(stamped_type && s)
+    {
+        if (s.value != nullptr)
+            m_stats.on_pop(s.stamp_ns);
+        return std::move(s.value);
+    }
+
+public:
+    explicit instrumented_queue(std::uint64_t sample_period = 64) :
+        m_stats{sample_period}
+    {}
+
+    void push(data_type new_value)
+    {
+        auto stamp = m_stats.on_push();
+        m_queue.push(stamped_type{std::move(new_value), stamp});
+    }
+
+    data_type try_pop() { return unwrap(m_queue.try_pop()); }
+    data_type wait_and_pop() { return unwrap(m_queue.wait_and_pop()); }
+
+    void terminate() { m_queue.terminate(); }
+
+    /* From the counters, safe from any thread */
+    std::size_t size() const { return static_cast<std::size_t>(m_stats.depth()); }
+
+    queue_stats const & stats() const { return m_stats; }
+    Q & queue() { return m_queue; }
+};
+
+#endif  // QUEUE_STATS_H
@@ -0,0 +1,114 @@
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../bench.hh"
+
+#define NAMESPACE_NAME refl_objs
+#define OBJECT_NAME ReflectionTest
+#define DEFINITION_FILE reflection_test.incl
+#include "reflection.hh"
+#undef OBJECT_NAME
+#undef DEFINITION_FILE
+
+/**
+ * Filtering and aggregating one field of many reflected records, kept as a
+ * std::vector of records against ReflectionTest_columns. Try -O3 too, the
+ * column loops are what the vectorizer gets to work on.
+ */
+
+using record = refl_objs::ReflectionTest;
+using columns = refl_objs::ReflectionTest_columns;
+
+constexpr std::size_t records = 1000000;
+constexpr float threshold = 90.0f;
+
+void add_throughput(bench::result & r)
+{
+    r.params.emplace_back("mrecords_per_s", std::to_string(r.ops / r.median_ns * 1000.0));
+}
+
+int main(int argc, char ** argv)
+{
+    bench::reporter rep{bench::parse_args(argc, argv)};
+
+    std::mt19937 g{42};
+    std::vector<record> rows;
+    columns cols;
+
+    rows.reserve(records);
+    cols.reserve(records);
+
+    for (std::size_t i = 0; i < records; ++i)
+    {
+        record r;
+        r.set_address("host-" + std::to_string(g() % 100000) + ".example.com");
+        r.set_vecta(std::vector<int>(g() % 4, 1));
+        r.set_latitude(static_cast<float>(g() % 18000) / 100.0f);
+        rows.push_back(r);
+        cols.push_back(std::move(r));
+    }
+
+    volatile float fsink = 0;
+    volatile std::size_t sink = 0;
+
+    auto run = [&](std::string const & name, std::string const & layout, auto body) {
+        if (!rep.wanted(name))
+            return;
+        auto r = bench::run(name, {{"layout", layout}, {"records", std::to_string(records)}},
+                            rep.opts(), records, body);
+        add_throughput(r);
+        rep.add(std::move(r));
+    };
+
+    run("count latitude > 90", "AoS", [&] {
+        std::size_t n = 0;
+        for (auto const & r : rows)
+            n += r.get_latitude() > threshold;
+        sink = n;
+    });
+
+    run("count latitude > 90", "SoA", [&] {
+        std::size_t n = 0;
+        for (auto l : cols.latitude_column())
+            n += l > threshold;
+        sink = n;
+    });
+
+    run("sum latitude where > 90", "AoS", [&] {
+        float sum = 0;
+        for (auto const & r : rows)
+            sum += r.get_latitude() > threshold ? r.get_latitude() : 0.0f;
+        fsink = sum;
+    });
+
+    run("sum latitude where > 90", "SoA", [&] {
+        float sum = 0;
+        for (auto l : cols.latitude_column())
+            sum += l > threshold ? l : 0.0f;
+        fsink = sum;
+    });
+
+    /* Touches a second column for the rows that pass */
+    run("sum vecta size where latitude > 90", "AoS", [&] {
+        std::size_t n = 0;
+        for (auto const & r : rows)
+            if (r.get_latitude() > threshold)
+                n += r.get_vecta().size();
+        sink = n;
+    });
+
+    run("sum vecta size where latitude > 90", "SoA", [&] {
+        auto const & lat = cols.latitude_column();
+        auto const & vecta = cols.vecta_column();
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < lat.size(); ++i)
+            if (lat[i] > threshold)
+                n += vecta[i].size();
+        sink = n;
+    });
+
+    rep.print(std::cout);
+}
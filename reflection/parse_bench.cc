@@ -0,0 +1,105 @@
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "../bench.hh"
+
+#define NAMESPACE_NAME refl_objs
+#define OBJECT_NAME ReflectionTest
+#define DEFINITION_FILE reflection_test.incl
+#include "reflection.hh"
+#undef OBJECT_NAME
+#undef DEFINITION_FILE
+
+/**
+ * Ingesting key=value lines into a reflected record: the std::regex
+ * tokenizer reflection_test.cc used to have, with std::stof, against the
+ * generated parse().
+ */
+
+using record = refl_objs::ReflectionTest;
+
+/* Lines per run */
+constexpr std::size_t lines = 100000;
+
+/* The old path, address and latitude only */
+void parse_regex(record & r, std::string const & input)
+{
+    static std::regex const sep{"=|,"};
+    std::sregex_token_iterator end_of_seq;
+    std::sregex_token_iterator token{input.begin(), input.end(), sep, -1};
+
+    while (token != end_of_seq)
+    {
+        std::string k = *token++;
+        std::string v = *token++;
+
+        if (k == "latitude")
+            r.set(k, std::stof(v));
+        else if (k == "address")
+            r.set(k, v);
+    }
+}
+
+void add_throughput(bench::result & r)
+{
+    r.params.emplace_back("mlines_per_s", std::to_string(r.ops / r.median_ns * 1000.0));
+}
+
+int main(int argc, char ** argv)
+{
+    bench::reporter rep{bench::parse_args(argc, argv)};
+
+    std::mt19937 g{42};
+    std::vector<std::string> scalar_lines, vector_lines;
+
+    for (std::size_t i = 0; i < lines; ++i)
+    {
+        auto address = "host-" + std::to_string(g() % 100000);
+        auto latitude = std::to_string(static_cast<float>(g() % 18000) / 100.0f) + "f";
+        scalar_lines.push_back("address=" + address + ",latitude=" + latitude);
+
+        std::string list = "[";
+        for (std::size_t j = 0, n = g() % 9; j < n; ++j)
+            list += (j ? "," : "") + std::to_string(static_cast<int>(g() % 10000));
+        vector_lines.push_back(scalar_lines.back() + ",vecta=" + list + "]");
+    }
+
+    record r;
+    volatile float sink = 0;
+
+    if (rep.wanted("std::regex + stof"))
+    {
+        auto res = bench::run("std::regex + stof", {{"fields", "2"}}, rep.opts(), lines, [&] {
+            for (auto const & l : scalar_lines)
+                parse_regex(r, l);
+            sink = r.get_latitude();
+        });
+        add_throughput(res);
+        rep.add(std::move(res));
+    }
+
+    if (rep.wanted("parse"))
+    {
+        auto res = bench::run("parse", {{"fields", "2"}}, rep.opts(), lines, [&] {
+            for (auto const & l : scalar_lines)
+                r.parse(l);
+            sink = r.get_latitude();
+        });
+        add_throughput(res);
+        rep.add(std::move(res));
+
+        res = bench::run("parse", {{"fields", "3 with vecta"}}, rep.opts(), lines, [&] {
+            for (auto const & l : vector_lines)
+                r.parse(l);
+            sink = r.get_latitude();
+        });
+        add_throughput(res);
+        rep.add(std::move(res));
+    }
+
+    rep.print(std::cout);
+}
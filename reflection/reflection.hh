@@ -13,42 +13,528 @@
 #define STRINGIFY(M)  #M
 #define XSTRINGIFY(M) STRINGIFY(M)
 #define INCLUDE_FILE  XSTRINGIFY(DEFINITION_FILE)
+#define CAT(A,B)      A ## B
+#define XCAT(A,B)     CAT(A,B)
+#define COLUMNS_NAME  XCAT(OBJECT_NAME, _columns)
 
-#include <map>
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <stdexcept>
-#include <boost/variant.hpp>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef REFLECTION_DETAIL_H
+#define REFLECTION_DETAIL_H
+/// Shared by every reflected type, only defined once
+namespace reflection_detail
+{
+    /// T, but dependent on D, for member templates whose bodies must only
+    /// be instantiated when they are used
+    template<typename D, typename T>
+    struct dependent
+    {
+        using type = T;
+    };
+
+    /// FNV-1a, one pass over the name for both hash levels
+    constexpr std::uint64_t hash(std::string_view s)
+    {
+        std::uint64_t h = 14695981039346656037ull;
+        for (char c : s)
+            h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        return h;
+    }
+
+    /// Rehashes h for displacement d (murmur3 finalizer)
+    constexpr std::uint64_t mix(std::uint64_t h, std::uint32_t d)
+    {
+        h ^= d * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /**
+     * @brief Perfect hash of N field names, built at compile time
+     * @details Hash and displace: the name's hash picks a bucket, the
+     *          bucket's displacement picks the slot. Slots are at most half
+     *          full so displacements are found in a few tries. find() gives
+     *          a field index which the caller still compares the name
+     *          against, or N.
+     */
+    template<std::size_t N>
+    struct perfect_hash
+    {
+        static constexpr std::size_t buckets = N ? N : 1;
+
+        static constexpr std::size_t table_size()
+        {
+            std::size_t n = 2;
+            while (n < 2 * N)
+                n *= 2;
+            return n;
+        }
+
+        static constexpr std::size_t slots = table_size();
+
+        std::uint32_t displacement[buckets] = {};
+        /// Field index + 1, 0 for an empty slot
+        std::uint32_t index[slots] = {};
+
+        constexpr std::size_t find(std::string_view s) const
+        {
+            auto h = hash(s);
+            auto d = displacement[(h >> 32) % buckets];
+            auto i = index[mix(h, d) & (slots - 1)];
+            return i ? i - 1 : N;
+        }
+    };
+
+    /// Fields are anything with a string_view name, names must be unique
+    template<typename Field, std::size_t N>
+    constexpr perfect_hash<N> make_perfect_hash(Field const (&fields)[N])
+    {
+        using table = perfect_hash<N>;
+        table t{};
+
+        std::uint64_t h[N] = {};
+        std::size_t sizes[table::buckets] = {};
+        std::size_t largest = 0;
+
+        for (std::size_t i = 0; i < N; ++i) {
+            h[i] = hash(fields[i].name);
+            for (std::size_t j = 0; j < i; ++j)
+                if (fields[i].name == fields[j].name)
+                    throw std::logic_error("duplicate field name");
+
+            auto & n = sizes[(h[i] >> 32) % table::buckets];
+            if (++n > largest)
+                largest = n;
+        }
+
+        /* Biggest buckets first while there is most room */
+        for (auto size = largest; size > 0; --size)
+            for (std::size_t b = 0; b < table::buckets; ++b)
+            {
+                if (sizes[b] != size)
+                    continue;
+
+                for (std::uint32_t d = 1;; ++d)
+                {
+                    if (d == 1u << 20)
+                        throw std::logic_error("no perfect hash found");
+
+                    bool ok = true;
+                    for (std::size_t i = 0; ok && i < N; ++i) {
+                        if ((h[i] >> 32) % table::buckets != b)
+                            continue;
+                        auto s = mix(h[i], d) & (table::slots - 1);
+                        if (t.index[s] != 0)
+                            ok = false;
+                        /* and no clash inside the bucket */
+                        for (std::size_t j = 0; ok && j < i; ++j)
+                            if ((h[j] >> 32) % table::buckets == b &&
+                                (mix(h[j], d) & (table::slots - 1)) == s)
+                                ok = false;
+                    }
+
+                    if (!ok)
+                        continue;
+
+                    t.displacement[b] = d;
+                    for (std::size_t i = 0; i < N; ++i)
+                        if ((h[i] >> 32) % table::buckets == b)
+                            t.index[mix(h[i], d) & (table::slots - 1)] =
+                                static_cast<std::uint32_t>(i + 1);
+                    break;
+                }
+            }
+
+        return t;
+    }
+
+    /**
+     * Binary encoding of reflected objects, see OBJECT_NAME::encode().
+     *
+     * record  u32 byte length of the fields, then the fields
+     * field   u16 key (tag << 4 | wire kind), then the value
+     * value   arithmetic: raw, 1/2/4/8 bytes (wire kind 0-3)
+     *         string: u32 byte count, the bytes (wire kind 4)
+     *         vector: u32 byte count, the elements as values (wire kind 4)
+     *
+     * Native byte order, which has to be little endian. The encoders are
+     * templates instantiated by OBJECT_NAME::encode() and decode(), other
+     * member types are fine as long as those aren't called. Unknown tags and
+     * tags whose wire kind changed are skipped, missing ones keep their
+     * defaults, so fields can be added to the end of a definition file.
+     */
+    static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "encoding is little endian");
+
+    constexpr std::uint16_t length_delimited = 4;
+
+    template<typename T>
+    struct is_vector : std::false_type {};
+
+    template<typename T, typename A>
+    struct is_vector<std::vector<T, A>> : std::true_type {};
+
+    template<typename T>
+    constexpr std::uint16_t wire_kind()
+    {
+        if constexpr (std::is_arithmetic<T>::value) {
+            /* skip() steps over 1 << kind bytes, long double wouldn't fit */
+            static_assert(sizeof(T) <= 8, "no wire kind for arithmetic types over 8 bytes");
+            return sizeof(T) == 1 ? 0 : sizeof(T) == 2 ? 1 : sizeof(T) == 4 ? 2 : 3;
+        }
+        else
+            return length_delimited;
+    }
+
+    /// Bounded output, ok goes false instead of overrunning
+    struct writer
+    {
+        char * p;
+        char * end;
+        bool ok = true;
+
+        void put(void const * src, std::size_t n)
+        {
+            if (static_cast<std::size_t>(end - p) < n) {
+                ok = false;
+                return;
+            }
+            /* empty vectors may have no data() */
+            if (n)
+                std::memcpy(p, src, n);
+            p += n;
+        }
+
+        /// Room for a u32 filled in later by patch()
+        char * reserve_u32()
+        {
+            char * at = p;
+            std::uint32_t zero = 0;
+            put(&zero, sizeof(zero));
+            return at;
+        }
+
+        void patch(char * at)
+        {
+            if (!ok)
+                return;
+            auto n = static_cast<std::uint32_t>(p - at - sizeof(std::uint32_t));
+            std::memcpy(at, &n, sizeof(n));
+        }
+    };
+
+    /// Bounded input, ok goes false on a short or malformed buffer
+    struct reader
+    {
+        char const * p;
+        char const * end;
+        bool ok = true;
+
+        std::size_t left() const { return static_cast<std::size_t>(end - p); }
+
+        void get(void * dst, std::size_t n)
+        {
+            if (left() < n) {
+                ok = false;
+                return;
+            }
+            std::memcpy(dst, p, n);
+            p += n;
+        }
+
+        /// Length prefixed region, empty and !ok if it doesn't fit
+        char const * region(std::uint32_t & n)
+        {
+            get(&n, sizeof(n));
+            if (!ok || left() < n) {
+                ok = false;
+                n = 0;
+                return p;
+            }
+            auto * at = p;
+            p += n;
+            return at;
+        }
+    };
+
+    template<typename T>
+    std::size_t encoded_size(T const & v)
+    {
+        if constexpr (std::is_arithmetic<T>::value)
+            return sizeof(T);
+        else if constexpr (std::is_same<T, std::string>::value)
+            return sizeof(std::uint32_t) + v.size();
+        else {
+            static_assert(is_vector<T>::value, "no encoding for this type");
+            using E = typename T::value_type;
+            /* vector<bool> as one byte per element */
+            if constexpr (std::is_arithmetic<E>::value)
+                return sizeof(std::uint32_t) + v.size() * sizeof(E);
+            else {
+                std::size_t n = sizeof(std::uint32_t);
+                for (auto const & e : v)
+                    n += encoded_size(e);
+                return n;
+            }
+        }
+    }
+
+    template<typename T>
+    void encode(writer & out, T const & v)
+    {
+        if constexpr (std::is_arithmetic<T>::value)
+            out.put(&v, sizeof(T));
+        else if constexpr (std::is_same<T, std::string>::value) {
+            auto n = static_cast<std::uint32_t>(v.size());
+            out.put(&n, sizeof(n));
+            out.put(v.data(), v.size());
+        }
+        else {
+            static_assert(is_vector<T>::value, "no encoding for this type");
+            using E = typename T::value_type;
+            if constexpr (std::is_same<E, bool>::value) {
+                auto n = static_cast<std::uint32_t>(v.size());
+                out.put(&n, sizeof(n));
+                for (bool b : v)
+                    encode(out, b);
+            }
+            else if constexpr (std::is_arithmetic<E>::value) {
+                auto n = static_cast<std::uint32_t>(v.size() * sizeof(E));
+                out.put(&n, sizeof(n));
+                out.put(v.data(), n);
+            }
+            else {
+                auto * at = out.reserve_u32();
+                for (auto const & e : v)
+                    encode(out, e);
+                out.patch(at);
+            }
+        }
+    }
+
+    /// Decodes into v, reusing whatever capacity it has
+    template<typename T>
+    void decode(reader & in, T & v)
+    {
+        /* Any byte but 0 is true, copying it into a bool could make a bad one */
+        if constexpr (std::is_same<T, bool>::value) {
+            unsigned char b = 0;
+            in.get(&b, sizeof(b));
+            v = b != 0;
+        }
+        else if constexpr (std::is_arithmetic<T>::value)
+            in.get(&v, sizeof(T));
+        else if constexpr (std::is_same<T, std::string>::value) {
+            std::uint32_t n;
+            auto * at = in.region(n);
+            v.assign(at, n);
+        }
+        else {
+            static_assert(is_vector<T>::value, "no encoding for this type");
+            using E = typename T::value_type;
+            std::uint32_t n;
+            auto * at = in.region(n);
+
+            if constexpr (std::is_same<E, bool>::value) {
+                v.resize(n);
+                for (std::uint32_t i = 0; i < n; ++i)
+                    v[i] = at[i] != 0;
+            }
+            else if constexpr (std::is_arithmetic<E>::value) {
+                if (n % sizeof(E) != 0) {
+                    in.ok = false;
+                    return;
+                }
+                v.resize(n / sizeof(E));
+                if (n)
+                    std::memcpy(v.data(), at, n);
+            }
+            else {
+                reader elems{at, at + n};
+                v.clear();
+                while (elems.ok && elems.left() != 0) {
+                    v.emplace_back();
+                    decode(elems, v.back());
+                }
+                in.ok = in.ok && elems.ok;
+            }
+        }
+    }
+
+    /// Steps over a value of the given wire kind
+    inline void skip(reader & in, std::uint16_t kind)
+    {
+        if (kind < length_delimited) {
+            std::size_t n = std::size_t{1} << kind;
+            if (in.left() < n)
+                in.ok = false;
+            else
+                in.p += n;
+        }
+        else if (kind == length_delimited) {
+            std::uint32_t n;
+            in.region(n);
+        }
+        else
+            in.ok = false;
+    }
+
+    /**
+     * key=value text, see OBJECT_NAME::parse().
+     *
+     *   address=test,vecta=[1,2,3],latitude=123.123f
+     *
+     * Spaces around keys and values are ignored. Numbers go through
+     * from_chars, floating point ones may end in f. bool is true/false or
+     * 1/0. Strings are taken as they are up to the next comma, vectors are
+     * comma separated in brackets. parse_value() is only instantiated for
+     * the member types of records whose parse() is called.
+     */
+    enum class parse_error
+    {
+        none,
+        /// key without =
+        missing_equals,
+        /// no field of that name
+        unknown_key,
+        /// value doesn't parse as the field's type
+        bad_value,
+        /// [ without ]
+        unterminated_list
+    };
+
+    struct parse_result
+    {
+        parse_error error = parse_error::none;
+        /// Offset of the offending key=value pair in the input
+        std::size_t position = 0;
+
+        explicit operator bool() const { return error == parse_error::none; }
+    };
+
+    constexpr std::string_view trim(std::string_view s)
+    {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+            s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+            s.remove_suffix(1);
+        return s;
+    }
+
+    /// Parses all of text into v, false and v untouched if it isn't a valid T
+    template<typename T>
+    bool parse_value(std::string_view text, T & v)
+    {
+        if constexpr (std::is_same<T, bool>::value) {
+            if (text == "true" || text == "1")
+                v = true;
+            else if (text == "false" || text == "0")
+                v = false;
+            else
+                return false;
+            return true;
+        }
+        else if constexpr (std::is_arithmetic<T>::value) {
+            auto const * end = text.data() + text.size();
+            /* A literal's f suffix, not the end of inf */
+            if constexpr (std::is_floating_point<T>::value)
+                if (text.size() > 1 && (text.back() == 'f' || text.back() == 'F') &&
+                    (std::isdigit(static_cast<unsigned char>(end[-2])) || end[-2] == '.'))
+                    --end;
+
+            T parsed{};
+            auto r = std::from_chars(text.data(), end, parsed);
+            if (r.ec != std::errc{} || r.ptr != end)
+                return false;
+            v = parsed;
+            return true;
+        }
+        else if constexpr (std::is_same<T, std::string>::value) {
+            v.assign(text.data(), text.size());
+            return true;
+        }
+        else {
+            static_assert(is_vector<T>::value, "no text form for this type");
+            if (text.size() < 2 || text.front() != '[' || text.back() != ']')
+                return false;
+            text = trim(text.substr(1, text.size() - 2));
+
+            /* Built aside so a bad element leaves v as it was */
+            T parsed;
+            while (!text.empty())
+            {
+                auto comma = text.find(',');
+                typename T::value_type item{};
+                if (!parse_value(trim(text.substr(0, comma)), item))
+                    return false;
+                parsed.push_back(std::move(item));
+                if (comma == std::string_view::npos)
+                    break;
+                text.remove_prefix(comma + 1);
+            }
+            v = std::move(parsed);
+            return true;
+        }
+    }
+}
+#endif  // REFLECTION_DETAIL_H
 
 namespace NAMESPACE_NAME
 {
+    class COLUMNS_NAME;
+
     /**
      * @brief Generic datatype used for generating POD style structs with
      *          member access via strings or tags.
-     * @details Uses X-macros extensively to build a struct with a
-     *          lookup map by TAG and a lookup man by string. The intent
-     *          was to use this for serializer interop where something wants
-     *          to retreive a member variable by TAG or by string name.
+     * @details Uses X-macros extensively to build a struct whose members
+     *          are reachable by TAG through a generated switch and by
+     *          string through a static field table, shared by every
+     *          instance, with a compile-time perfect hash. Values live
+     *          only in the members. The intent was to use this for
+     *          serializer interop where something wants to retreive a
+     *          member variable by TAG or by string name.
      *
      *          some_data d{};
      *          d.set(TAG1, value1);
-     *          auto x = d.get(TAG1);
+     *          d.set("tag1", std::move(value1));
      *
      *          std::string y;
      *          d.get("tag1", y);
+     *
+     *          d.visit(TAG1, [](auto const & member) { ... });
+     *
+     *          get() wants the member's exact type, set() anything
+     *          implicitly convertible to it, otherwise they throw.
+     *
+     *          encode()/decode() read and write the binary format in
+     *          reflection_detail into a caller's buffer, tags are the field
+     *          ids so new fields go at the end of the definition file.
+     *          They want members that are arithmetic, std::string or
+     *          std::vector of those, and are templates so other member
+     *          types only fail to build if they are called.
+     *
+     *          parse() sets fields from key=value text, see
+     *          reflection_detail::parse_error, without throwing.
+     *
+     *          OBJECT_NAME_columns holds many of them column by column.
      */
     class OBJECT_NAME final
     {
     private:
-        /// Typedef for our variant type
-        /// It's a little scary that this works since we can have
-        /// multiple identical template args ... maybe boost::variant
-        /// filters via MPL
-        using variant = boost::variant<
-#           define REFLECT(rt,n,c,d) rt,
-#           include INCLUDE_FILE
-#           undef REFLECT
-            std::nullptr_t // terminator since we cant end in a comma
-            >;
+        friend class COLUMNS_NAME;
 
         /// Creates properties
 #       define REFLECT(rt,n,c,d) rt n = d;
@@ -63,48 +549,116 @@ namespace NAMESPACE_NAME
 #           undef REFLECT
         };
 
+        /// One entry per property, in REFLECT order
+        struct field
+        {
+            std::string_view name;
+            Tag tag;
+        };
+
+        /// Field table shared by all instances
+        static constexpr field fields[] =
+        {
+#       define REFLECT(rt,n,c,d) { STRINGIFY(n), c },
+#       include INCLUDE_FILE
+#       undef REFLECT
+        };
+
+        static constexpr std::size_t field_count = sizeof(fields) / sizeof(fields[0]);
+
+        /// Looks up a property name, false if there is no such property
+        static constexpr bool find_tag(std::string_view name, Tag & tag)
+        {
+            auto i = name_index.find(name);
+            if (i == field_count || fields[i].name != name)
+                return false;
+            tag = fields[i].tag;
+            return true;
+        }
+
+        /// Tag for a property name, throws for an unknown name
+        static Tag tag_of(std::string_view name)
+        {
+            Tag tag{};
+            if (!find_tag(name, tag))
+                throw std::runtime_error("Invalid name");
+            return tag;
+        }
+
+        /// Calls f with a reference to the member for tag
+        template<typename F>
+            void visit(Tag tag, F && f)
+            {
+                switch(tag)
+                {
+#               define REFLECT(rt,n,c,d) case c: f(this->n); break;
+#               include INCLUDE_FILE
+#               undef REFLECT
+                default:
+                    throw std::runtime_error("Invalid Tag");
+                }
+            }
+
+        template<typename F>
+            void visit(Tag tag, F && f) const
+            {
+                switch(tag)
+                {
+#               define REFLECT(rt,n,c,d) case c: f(this->n); break;
+#               include INCLUDE_FILE
+#               undef REFLECT
+                default:
+                    throw std::runtime_error("Invalid Tag");
+                }
+            }
+
+        template<typename F>
+            void visit(std::string_view s, F && f) { visit(tag_of(s), std::forward<F>(f)); }
+
+        template<typename F>
+            void visit(std::string_view s, F && f) const { visit(tag_of(s), std::forward<F>(f)); }
+
         /// Templated get from Tag key
         template<typename T>
-            void get(Tag tag, T & fill)
+            void get(Tag tag, T & fill) const
             {
-                auto p = mapped_items[tag];
-                fill = boost::get<T>(p);
+                visit(tag, [&](auto const & member) {
+                    if constexpr (std::is_same<std::decay_t<decltype(member)>, T>::value)
+                        fill = member;
+                    else
+                        throw std::runtime_error("Invalid type");
+                });
             }
 
         /// Template get from string
         template<typename T>
-            void get(std::string const & s, T & fill)
+            void get(std::string_view s, T & fill) const
             {
-                auto t = item_lookup[s];
-                get(t, fill);
+                get(tag_of(s), fill);
             }
 
-        /// Generic set from variant type
-        void set(Tag tag, variant value)
-        {
-            // set in the map
-            mapped_items[tag] = value;
-
-            // set the property
-            switch(tag)
+        /// Generic set from Tag key, moves from rvalues
+        template<typename T>
+            void set(Tag tag, T && value)
             {
-#           define REFLECT(rt,n,c,d) case c: n = boost::get<rt>(value); break;
-#           include INCLUDE_FILE
-#           undef REFLECT
-            default:
-                throw std::runtime_error("Invalid Tag");
+                visit(tag, [&](auto & member) {
+                    using member_type = std::decay_t<decltype(member)>;
+                    if constexpr (std::is_convertible<T &&, member_type>::value)
+                        member = std::forward<T>(value);
+                    else
+                        throw std::runtime_error("Invalid type");
+                });
             }
-        }
 
         /// Generic set from STRING
-        void set(std::string const & s, variant value)
-        {
-            auto i = item_lookup[s];
-            set(i, std::move(value));
-        }
+        template<typename T>
+            void set(std::string_view s, T && value)
+            {
+                set(tag_of(s), std::forward<T>(value));
+            }
 
         /// Generates a set-property function for each propery
-#       define REFLECT(rt,n,c,d) void set_ ## n(rt val) { set(c, val); }
+#       define REFLECT(rt,n,c,d) void set_ ## n(rt val) { this->n = std::move(val); }
 #       include INCLUDE_FILE
 #       undef REFLECT
 
@@ -113,27 +667,374 @@ namespace NAMESPACE_NAME
 #       include INCLUDE_FILE
 #       undef REFLECT
 
-    private:
-        /// Statically creates a tag->variant map
-        std::map<Tag, variant> mapped_items =
+        /// Bytes encode() needs for this record
+        template<typename D = void>
+        std::size_t encoded_size() const
         {
-#       define REFLECT(rt,n,c,d) { c, rt(d) },
+            typename reflection_detail::dependent<D, OBJECT_NAME>::type const & self = *this;
+            std::size_t bytes = sizeof(std::uint32_t);
+#       define REFLECT(rt,n,c,d) bytes += sizeof(std::uint16_t) + reflection_detail::encoded_size(self.n);
 #       include INCLUDE_FILE
 #       undef REFLECT
-        };
+            return bytes;
+        }
 
-        /// Statically creates a string->tag lookup map
-        std::map<std::string, Tag> item_lookup =
+        /**
+         * @brief Writes the record to buf
+         * @return Bytes written, 0 if it doesn't fit in size
+         */
+        template<typename D = void>
+        std::size_t encode(char * buf, std::size_t size) const
         {
-#       define REFLECT(rt,n,c,d) { STRINGIFY(n), c },
+            typename reflection_detail::dependent<D, OBJECT_NAME>::type const & self = *this;
+            reflection_detail::writer out{buf, buf + size};
+            auto * length = out.reserve_u32();
+
+#       define REFLECT(rt,n,c,d) \
+            { \
+                auto key = static_cast<std::uint16_t>(c << 4 | reflection_detail::wire_kind<rt>()); \
+                out.put(&key, sizeof(key)); \
+                reflection_detail::encode(out, self.n); \
+            }
+#       include INCLUDE_FILE
+#       undef REFLECT
+
+            out.patch(length);
+            return out.ok ? static_cast<std::size_t>(out.p - buf) : 0;
+        }
+
+        /**
+         * @brief Reads a record written by encode() into this one, fields
+         *          the buffer doesn't have are set to their defaults
+         * @return Bytes read, 0 for a short or malformed buffer, which can
+         *          leave the record partly decoded
+         */
+        template<typename D = void>
+        std::size_t decode(char const * buf, std::size_t size)
+        {
+            typename reflection_detail::dependent<D, OBJECT_NAME>::type & self = *this;
+            reflection_detail::reader in{buf, buf + size};
+            std::uint32_t length;
+            auto * at = in.region(length);
+            reflection_detail::reader fields_in{at, at + length};
+            bool seen[field_count] = {};
+
+            while (in.ok && fields_in.ok && fields_in.left() != 0)
+            {
+                std::uint16_t key;
+                fields_in.get(&key, sizeof(key));
+                if (!fields_in.ok)
+                    break;
+
+                auto kind = static_cast<std::uint16_t>(key & 0xf);
+                switch(key >> 4)
+                {
+#               define REFLECT(rt,n,c,d) \
+                case c: \
+                    if (kind == reflection_detail::wire_kind<rt>()) { \
+                        reflection_detail::decode(fields_in, self.n); \
+                        seen[c] = true; \
+                    } \
+                    else \
+                        reflection_detail::skip(fields_in, kind); \
+                    break;
+#               include INCLUDE_FILE
+#               undef REFLECT
+                default:
+                    reflection_detail::skip(fields_in, kind);
+                }
+            }
+
+            if (!in.ok || !fields_in.ok)
+                return 0;
+
+#       define REFLECT(rt,n,c,d) if (!seen[c]) self.n = d;
+#       include INCLUDE_FILE
+#       undef REFLECT
+
+            return static_cast<std::size_t>(in.p - buf);
+        }
+
+        /**
+         * @brief Writes a record count and count records to buf
+         * @return Bytes written, 0 if they don't fit in size
+         */
+        template<typename D = void>
+        static std::size_t encode_batch(OBJECT_NAME const * objs, std::size_t count,
+                                        char * buf, std::size_t size)
+        {
+            reflection_detail::writer out{buf, buf + size};
+            auto n = static_cast<std::uint32_t>(count);
+            out.put(&n, sizeof(n));
+
+            for (std::size_t i = 0; out.ok && i < count; ++i) {
+                auto bytes = objs[i].template encode<D>(out.p, static_cast<std::size_t>(out.end - out.p));
+                out.ok = bytes != 0;
+                out.p += bytes;
+            }
+
+            return out.ok ? static_cast<std::size_t>(out.p - buf) : 0;
+        }
+
+        /**
+         * @brief Reads records written by encode_batch() into objs, resized
+         *          to the count, existing records are decoded over
+         * @return Bytes read, 0 for a short or malformed buffer
+         */
+        template<typename D = void>
+        static std::size_t decode_batch(char const * buf, std::size_t size,
+                                        std::vector<OBJECT_NAME> & objs)
+        {
+            reflection_detail::reader in{buf, buf + size};
+            std::uint32_t count;
+            in.get(&count, sizeof(count));
+            /* Every record is at least its length */
+            if (!in.ok || count > in.left() / sizeof(std::uint32_t))
+                return 0;
+
+            objs.resize(count);
+            for (auto & o : objs) {
+                auto bytes = o.template decode<D>(in.p, in.left());
+                if (bytes == 0)
+                    return 0;
+                in.p += bytes;
+            }
+
+            return static_cast<std::size_t>(in.p - buf);
+        }
+
+        /**
+         * @brief Sets fields from comma separated key=value pairs, see
+         *          reflection_detail for the value syntax
+         * @return The first error and where it is, pairs before it have
+         *          been applied
+         */
+        template<typename D = void>
+        reflection_detail::parse_result parse(std::string_view text)
+        {
+            typename reflection_detail::dependent<D, OBJECT_NAME>::type & self = *this;
+            using reflection_detail::parse_error;
+            std::size_t pos = 0;
+
+            while (pos < text.size())
+            {
+                auto rest = text.substr(pos);
+                auto eq = rest.find('=');
+                auto comma = rest.find(',');
+
+                if (eq == std::string_view::npos || comma < eq) {
+                    /* Nothing but blanks between two commas is fine */
+                    if (reflection_detail::trim(rest.substr(0, comma)).empty()) {
+                        pos = comma == std::string_view::npos ? text.size() : pos + comma + 1;
+                        continue;
+                    }
+                    return {parse_error::missing_equals, pos};
+                }
+
+                Tag tag{};
+                if (!find_tag(reflection_detail::trim(rest.substr(0, eq)), tag))
+                    return {parse_error::unknown_key, pos};
+
+                auto value_start = eq + 1;
+                while (value_start < rest.size() && (rest[value_start] == ' ' || rest[value_start] == '\t'))
+                    ++value_start;
+
+                /* A list runs to its ], commas inside belong to it */
+                std::size_t value_end = comma;
+                if (value_start < rest.size() && rest[value_start] == '[') {
+                    auto close = rest.find(']', value_start);
+                    if (close == std::string_view::npos)
+                        return {parse_error::unterminated_list, pos};
+                    value_end = rest.find(',', close);
+                }
+
+                auto value = reflection_detail::trim(rest.substr(value_start, value_end - value_start));
+                bool ok = false;
+                self.visit(tag, [&](auto & member) { ok = reflection_detail::parse_value(value, member); });
+                if (!ok)
+                    return {parse_error::bad_value, pos};
+
+                pos = value_end == std::string_view::npos ? text.size() : pos + value_end + 1;
+            }
+
+            return {};
+        }
+
+    private:
+        /// Compile-time string->tag lookup into fields
+        static constexpr auto name_index = reflection_detail::make_perfect_hash(fields);
+    };
+
+    /**
+     * @brief OBJECT_NAME records stored as one vector per property
+     * @details A scan over one property walks only that property's
+     *          contiguous column, which the compiler can vectorize, instead
+     *          of pulling whole records through the cache.
+     *
+     *          some_data_columns cols;
+     *          cols.push_back(record);
+     *          for (auto x : cols.tag1_column())   // column
+     *              ...
+     *          cols[i].set_tag1(value);            // row proxy
+     *          some_data r = cols.get(i);          // back to a record
+     */
+    class COLUMNS_NAME final
+    {
+    private:
+        /// One column per property
+#       define REFLECT(rt,n,c,d) std::vector<rt> m_ ## n ## _column;
 #       include INCLUDE_FILE
 #       undef REFLECT
+
+        /// Rows, the length of every column
+        std::size_t m_size = 0;
+
+        /// Room for one more row in every column up front, so a full
+        /// column can't reallocate and throw halfway through an append
+        void grow()
+        {
+#           define REFLECT(rt,n,c,d) \
+            if (m_ ## n ## _column.size() == m_ ## n ## _column.capacity()) \
+                m_ ## n ## _column.reserve(m_size ? 2 * m_size : 1);
+#           include INCLUDE_FILE
+#           undef REFLECT
+        }
+
+        /// Drops what a failed append left past m_size
+        void truncate() noexcept
+        {
+#           define REFLECT(rt,n,c,d) if (m_ ## n ## _column.size() > m_size) m_ ## n ## _column.pop_back();
+#           include INCLUDE_FILE
+#           undef REFLECT
+        }
+
+    public:
+        /// A record's place in the columns by index, so it survives them
+        /// reallocating but not the row going away
+        template<typename Columns>
+        class basic_row
+        {
+        private:
+            Columns * m_columns;
+            std::size_t m_index;
+
+        public:
+            basic_row(Columns & columns, std::size_t index) : m_columns{&columns}, m_index{index} {}
+
+#           define REFLECT(rt,n,c,d) decltype(auto) get_ ## n() const { return m_columns->m_ ## n ## _column[m_index]; }
+#           include INCLUDE_FILE
+#           undef REFLECT
+
+#           define REFLECT(rt,n,c,d) void set_ ## n(rt val) const { m_columns->m_ ## n ## _column[m_index] = std::move(val); }
+#           include INCLUDE_FILE
+#           undef REFLECT
         };
+
+        using row = basic_row<COLUMNS_NAME>;
+        using const_row = basic_row<COLUMNS_NAME const>;
+
+        std::size_t size() const { return m_size; }
+        bool empty() const { return m_size == 0; }
+
+        void reserve(std::size_t count)
+        {
+#           define REFLECT(rt,n,c,d) m_ ## n ## _column.reserve(count);
+#           include INCLUDE_FILE
+#           undef REFLECT
+        }
+
+        void clear()
+        {
+#           define REFLECT(rt,n,c,d) m_ ## n ## _column.clear();
+#           include INCLUDE_FILE
+#           undef REFLECT
+            m_size = 0;
+        }
+
+        /// Appends a copy of r, the columns are unchanged if a copy throws
+        void push_back(OBJECT_NAME const & r)
+        {
+            grow();
+            try {
+#           define REFLECT(rt,n,c,d) m_ ## n ## _column.push_back(r.n);
+#           include INCLUDE_FILE
+#           undef REFLECT
+            }
+            catch (...) {
+                truncate();
+                throw;
+            }
+            ++m_size;
+        }
+
+        void push_back(OBJECT_NAME && r)
+        {
+            grow();
+            try {
+#           define REFLECT(rt,n,c,d) m_ ## n ## _column.push_back(std::move(r.n));
+#           include INCLUDE_FILE
+#           undef REFLECT
+            }
+            catch (...) {
+                truncate();
+                throw;
+            }
+            ++m_size;
+        }
+
+        /// Appends a record of defaults
+        row emplace_back()
+        {
+            grow();
+            try {
+#           define REFLECT(rt,n,c,d) m_ ## n ## _column.push_back(d);
+#           include INCLUDE_FILE
+#           undef REFLECT
+            }
+            catch (...) {
+                truncate();
+                throw;
+            }
+            return row{*this, m_size++};
+        }
+
+        row operator[](std::size_t i) { return row{*this, i}; }
+        const_row operator[](std::size_t i) const { return const_row{*this, i}; }
+
+        /// Copies row i out as a record
+        OBJECT_NAME get(std::size_t i) const
+        {
+            OBJECT_NAME r;
+#           define REFLECT(rt,n,c,d) r.n = m_ ## n ## _column[i];
+#           include INCLUDE_FILE
+#           undef REFLECT
+            return r;
+        }
+
+        /// Generates a column accessor for each property
+#       define REFLECT(rt,n,c,d) std::vector<rt> const & n ## _column() const { return m_ ## n ## _column; }
+#       include INCLUDE_FILE
+#       undef REFLECT
+
+        /// Column data to update in place, size() elements. A template so
+        /// it is only built when called, std::vector<bool> has no data()
+#       define REFLECT(rt,n,c,d) \
+        template<typename D = void> \
+        auto n ## _data() \
+        { \
+            typename reflection_detail::dependent<D, COLUMNS_NAME>::type & self = *this; \
+            return self.m_ ## n ## _column.data(); \
+        }
+#       include INCLUDE_FILE
+#       undef REFLECT
     };
 
 #undef STRINGIFY
 #undef XSTRINGIFY
 #undef INCLUDE_FILE
+#undef CAT
+#undef XCAT
+#undef COLUMNS_NAME
 #undef REFLECT
 #undef NAMESPACE_NAME
 }
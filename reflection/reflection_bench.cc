@@ -0,0 +1,105 @@
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../alloc_counter.hh"
+#include "../bench.hh"
+
+#define NAMESPACE_NAME refl_objs
+#define OBJECT_NAME ReflectionTest
+#define DEFINITION_FILE reflection_test.incl
+#include "reflection.hh"
+#undef OBJECT_NAME
+#undef DEFINITION_FILE
+
+#define NAMESPACE_NAME map_objs
+#define OBJECT_NAME ReflectionTest
+#define DEFINITION_FILE reflection_test.incl
+#include "reflection_maps.hh"
+#undef OBJECT_NAME
+#undef DEFINITION_FILE
+
+/**
+ * reflection.hh against the map based original (reflection_maps.hh) on the
+ * same definition file: what a record costs to construct and hold, and
+ * get/set by property name.
+ */
+
+/* Records per run */
+constexpr std::size_t records = 10000;
+
+template<typename Record>
+void bench_record(bench::reporter & rep, std::string const & version)
+{
+    std::vector<Record> objs;
+    volatile float sink = 0;
+
+    /* Footprint of one default constructed record */
+    bench::params params = {{"version", version},
+                            {"sizeof", std::to_string(sizeof(Record))}};
+    {
+        auto allocs = heap_allocations, bytes = heap_bytes;
+        Record r{};
+        allocs = heap_allocations - allocs;
+        bytes = heap_bytes - bytes;
+        params.emplace_back("heap_allocs", std::to_string(allocs));
+        params.emplace_back("heap_bytes", std::to_string(bytes));
+    }
+
+    if (rep.wanted("construct"))
+        rep.add(bench::run("construct", params, rep.opts(), records, [&] {
+            objs.clear();
+            objs.shrink_to_fit();
+        }, [&] {
+            objs.resize(records);
+        }));
+
+    objs.resize(records);
+
+    if (rep.wanted("get by name float"))
+        rep.add(bench::run("get by name float", params, rep.opts(), records, [&] {
+            float sum = 0;
+            for (auto & o : objs) {
+                float f;
+                o.get("latitude", f);
+                sum += f;
+            }
+            sink = sum;
+        }));
+
+    if (rep.wanted("get by name string"))
+        rep.add(bench::run("get by name string", params, rep.opts(), records, [&] {
+            std::size_t sum = 0;
+            std::string s;
+            for (auto & o : objs) {
+                o.get("address", s);
+                sum += s.size();
+            }
+            sink = static_cast<float>(sum);
+        }));
+
+    if (rep.wanted("set by name string"))
+        rep.add(bench::run("set by name string", params, rep.opts(), records, [&] {
+            std::string const s = "10.0.0.1";
+            for (auto & o : objs)
+                o.set("address", s);
+        }));
+
+    if (rep.wanted("set by name float"))
+        rep.add(bench::run("set by name float", params, rep.opts(), records, [&] {
+            float f = 0;
+            for (auto & o : objs)
+                o.set("latitude", f += 1.0f);
+        }));
+}
+
+int main(int argc, char ** argv)
+{
+    bench::reporter rep{bench::parse_args(argc, argv)};
+
+    bench_record<map_objs::ReflectionTest>(rep, "maps");
+    bench_record<refl_objs::ReflectionTest>(rep, "field table");
+
+    rep.print(std::cout);
+}
@@ -17,7 +17,6 @@
 
 //////
 
-#include <regex>
 #include <iostream>
 
 int main()
@@ -42,25 +41,30 @@ int main()
 
     // Parse something from string
     std::string input{"address=test,latitude=123.123f"};
-    std::regex sep{"=|,"};
-    std::sregex_token_iterator end_of_seq;
-    std::sregex_token_iterator token{input.begin(), input.end(), sep, -1};
-
-    while (token != end_of_seq)
-    {
-        std::string k = *token++;
-        std::string v = *token++;
-
-        if (k == "latitude") {
-            std::cout << "Setting '" << k << "' to '" << v << "' via regex\n";
-            r.set(k, std::stof(v));
-        }
-        else if (k == "address") {
-            std::cout << "Setting '" << k << "' to '" << v << "' via regex\n";
-            r.set(k, v);
-        }
-    }
+    if (auto res = r.parse(input))
+        std::cout << "Parsed '" << input << "'\n";
+    else
+        std::cout << "Parse error " << static_cast<int>(res.error)
+                  << " at " << res.position << "\n";
 
     std::cout << "Final address: " << r.get_address() << std::endl
               << "Final latitude: " << std::fixed << r.get_latitude() << std::endl;
+
+    // Binary round trip, then every truncation of it must be rejected
+    std::vector<char> buf(r.encoded_size());
+    auto bytes = r.encode(buf.data(), buf.size());
+    refl_objs::ReflectionTest copy{};
+    bool ok = bytes == buf.size() && copy.decode(buf.data(), bytes) == bytes &&
+              copy.get_address() == r.get_address() && copy.get_vecta() == r.get_vecta() &&
+              copy.get_latitude() == r.get_latitude();
+    std::cout << "Round trip (" << bytes << " bytes): " << (ok ? "ok" : "FAILED") << std::endl;
+
+    bool short_ok = true;
+    for (std::size_t n = 0; n < bytes; ++n)
+        short_ok = short_ok && copy.decode(buf.data(), n) == 0;
+    std::vector<char> small(bytes - 1);
+    short_ok = short_ok && r.encode(small.data(), small.size()) == 0;
+    std::cout << "Short buffers rejected: " << (short_ok ? "ok" : "FAILED") << std::endl;
+
+    return ok && short_ok ? 0 : 1;
 }
@@ -0,0 +1,103 @@
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../bench.hh"
+
+#define NAMESPACE_NAME refl_objs
+#define OBJECT_NAME ReflectionTest
+#define DEFINITION_FILE reflection_test.incl
+#include "reflection.hh"
+#undef OBJECT_NAME
+#undef DEFINITION_FILE
+
+/**
+ * Binary encode/decode throughput of reflected records, one at a time and
+ * in batches, over records with 8-40 byte addresses and 0-16 ints.
+ */
+
+using record = refl_objs::ReflectionTest;
+
+/* Records per run */
+constexpr std::size_t records = 10000;
+
+void add_throughput(bench::result & r, std::size_t bytes)
+{
+    r.params.emplace_back("bytes", std::to_string(bytes));
+    r.params.emplace_back("mb_per_s", std::to_string(bytes / r.median_ns * 1e9 / (1 << 20)));
+}
+
+int main(int argc, char ** argv)
+{
+    bench::reporter rep{bench::parse_args(argc, argv)};
+
+    std::mt19937 g{42};
+    std::vector<record> objs(records);
+    std::size_t total = sizeof(std::uint32_t);
+
+    for (auto & o : objs)
+    {
+        o.set_address(std::string(8 + g() % 33, 'a' + static_cast<char>(g() % 26)));
+        std::vector<int> v(g() % 17);
+        for (auto & i : v)
+            i = static_cast<int>(g());
+        o.set_vecta(std::move(v));
+        o.set_latitude(static_cast<float>(g() % 18000) / 100.0f);
+        total += o.encoded_size();
+    }
+
+    std::vector<char> buf(total);
+    volatile std::size_t sink = 0;
+
+    if (rep.wanted("encode"))
+    {
+        auto r = bench::run("encode", {}, rep.opts(), records, [&] {
+            char * p = buf.data();
+            char * end = p + buf.size();
+            for (auto const & o : objs)
+                p += o.encode(p, static_cast<std::size_t>(end - p));
+            sink = static_cast<std::size_t>(p - buf.data());
+        });
+        add_throughput(r, total - sizeof(std::uint32_t));
+        rep.add(std::move(r));
+    }
+
+    if (rep.wanted("encode_batch"))
+    {
+        auto r = bench::run("encode_batch", {}, rep.opts(), records, [&] {
+            sink = record::encode_batch(objs.data(), objs.size(), buf.data(), buf.size());
+        });
+        add_throughput(r, total);
+        rep.add(std::move(r));
+    }
+
+    record::encode_batch(objs.data(), objs.size(), buf.data(), buf.size());
+    std::vector<record> decoded;
+
+    /* Into the same records every run, their buffers get reused */
+    if (rep.wanted("decode_batch"))
+    {
+        auto r = bench::run("decode_batch", {}, rep.opts(), records, [&] {
+            sink = record::decode_batch(buf.data(), buf.size(), decoded);
+        });
+        add_throughput(r, total);
+        rep.add(std::move(r));
+    }
+
+    /* Fresh records every run */
+    if (rep.wanted("decode_batch cold"))
+    {
+        auto r = bench::run("decode_batch cold", {}, rep.opts(), records, [&] {
+            decoded.clear();
+            decoded.shrink_to_fit();
+        }, [&] {
+            sink = record::decode_batch(buf.data(), buf.size(), decoded);
+        });
+        add_throughput(r, total);
+        rep.add(std::move(r));
+    }
+
+    rep.print(std::cout);
+}
@@ -25,36 +25,160 @@
 
 #include <cstddef>
 #include <cassert>
+#include <cstring>
+#include <new>
 
-template <std::size_t N, std::size_t alignment = alignof(std::max_align_t)>
-class arena
+// Released buffer bytes are filled with 0xdd in debug builds and poisoned
+// under AddressSanitizer, so use after rewind()/reset() shows up.
+#if defined(__SANITIZE_ADDRESS__)
+#  define SHORT_ALLOC_ASAN 1
+#elif defined(__has_feature)
+#  if __has_feature(address_sanitizer)
+#    define SHORT_ALLOC_ASAN 1
+#  endif
+#endif
+
+#ifdef SHORT_ALLOC_ASAN
+#  include <sanitizer/asan_interface.h>
+#  define SHORT_ALLOC_POISON(p, n) ASAN_POISON_MEMORY_REGION((p), (n))
+#  define SHORT_ALLOC_UNPOISON(p, n) ASAN_UNPOISON_MEMORY_REGION((p), (n))
+#else
+#  define SHORT_ALLOC_POISON(p, n) ((void)(p), (void)(n))
+#  define SHORT_ALLOC_UNPOISON(p, n) ((void)(p), (void)(n))
+#endif
+
+// What an arena does when a request doesn't fit in its buffer.
+//   heap            ::operator new, the original behaviour
+//   chain           the secondary arena given to chain(), which applies its
+//                   own policy when it runs out too
+//   throw_bad_alloc throw std::bad_alloc, for sections that must not
+//                   touch the heap
+//   abort_in_debug  assert in debug builds, heap in release builds
+enum class arena_overflow { heap, chain, throw_bad_alloc, abort_in_debug };
+
+// Counters for sizing arenas from data
+struct arena_stats
 {
-    alignas(alignment) char buf_[N];
+    std::size_t hits = 0;            // allocations served from the buffer
+    std::size_t overflows = 0;       // allocations that didn't fit
+    std::size_t overflow_bytes = 0;  // bytes of those
+    std::size_t peak_used = 0;       // high-water mark of used()
+    std::size_t wasted_bytes = 0;    // non-LIFO frees stranded until reset()
+};
+
+// A saved bump position, see arena_base::mark()
+struct arena_marker
+{
+    char* ptr;
+    std::size_t wasted_bytes;
+};
+
+// Bump allocation over a buffer owned by a derived class (arena, mmap_arena).
+// Any power of two alignment works, heap fallback uses aligned operator new
+// when the default new alignment isn't enough.
+template <std::size_t alignment = alignof(std::max_align_t)>
+class arena_base
+{
+    static_assert((alignment & (alignment - 1)) == 0, "alignment must be a power of two");
+
+    char* buf_;
+    char* end_;
     char* ptr_;
+    arena_stats stats_;
+    arena_overflow overflow_ = arena_overflow::heap;
+
+    // Type-erased secondary arena for arena_overflow::chain
+    void* next_ = nullptr;
+    char* (*next_allocate_)(void*, std::size_t) = nullptr;
+    void (*next_deallocate_)(void*, char*, std::size_t) = nullptr;
+
+protected:
+    // The owner's buffer goes back to normal stack/heap use
+    ~arena_base() {SHORT_ALLOC_UNPOISON(buf_, static_cast<std::size_t>(end_ - buf_)); ptr_ = nullptr;}
+    arena_base(char* buf, std::size_t n) noexcept : buf_(buf), end_(buf + n), ptr_(buf) {}
 
 public:
-    ~arena() {ptr_ = nullptr;}
-    arena() noexcept : ptr_(buf_) {}
-    arena(const arena&) = delete;
-    arena& operator=(const arena&) = delete;
+    arena_base(const arena_base&) = delete;
+    arena_base& operator=(const arena_base&) = delete;
 
     template <std::size_t ReqAlign> char* allocate(std::size_t n);
     void deallocate(char* p, std::size_t n) noexcept;
 
-    static constexpr std::size_t size() noexcept {return N;}
     std::size_t used() const noexcept {return static_cast<std::size_t>(ptr_ - buf_);}
-    void reset() noexcept {ptr_ = buf_;}
+    void reset() noexcept {rewind(arena_marker{buf_, 0});}
+    bool owns(const char* p) const noexcept {return buf_ <= p && p < end_;}
+
+    const arena_stats& stats() const noexcept {return stats_;}
+    void reset_stats() noexcept {stats_ = arena_stats{}; stats_.peak_used = used();}
+
+    arena_overflow overflow() const noexcept {return overflow_;}
+    void set_overflow(arena_overflow o) noexcept {overflow_ = o;}
+
+    // mark() saves the bump position, rewind() drops everything allocated
+    // from the buffer since then in O(1). Markers nest, rewind them in
+    // reverse order. Nothing allocated after the mark may be used or
+    // deallocated afterwards; heap or chained overflow isn't reclaimed, so
+    // pair this with arena_overflow::throw_bad_alloc or a roomy buffer.
+    arena_marker mark() const noexcept {return arena_marker{ptr_, stats_.wasted_bytes};}
+    void rewind(arena_marker m) noexcept;
+
+    // Sends overflow to next, which must outlive every allocation made
+    // through this arena. next may be any arena-like type with at least our
+    // alignment.
+    template <class Next> void chain(Next& next) noexcept;
 
 private:
+    void release(char* p) noexcept
+    {
+        auto const n = static_cast<std::size_t>(ptr_ - p);
+#ifndef NDEBUG
+        std::memset(p, 0xdd, n);
+#endif
+        SHORT_ALLOC_POISON(p, n);
+        ptr_ = p;
+    }
+
+    static constexpr bool over_aligned = alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
     static std::size_t align_up(std::size_t n) noexcept {return (n + (alignment-1)) & ~(alignment-1);}
 
     bool
-        pointer_in_buffer(char* p) noexcept {return buf_ <= p && p <= buf_ + N;}
+        pointer_in_buffer(char* p) noexcept {return buf_ <= p && p <= end_;}
+
+    char* overflow_allocate(std::size_t n);
+
+    static char* heap_allocate(std::size_t n)
+    {
+        return static_cast<char*>(over_aligned ? ::operator new(n, std::align_val_t{alignment})
+                                               : ::operator new(n));
+    }
+
+    static void heap_deallocate(char* p) noexcept
+    {
+        if (over_aligned)
+            ::operator delete(p, std::align_val_t{alignment});
+        else
+            ::operator delete(p);
+    }
 };
 
-template <std::size_t N, std::size_t alignment>
+template <std::size_t alignment>
+template <class Next>
+void arena_base<alignment>::chain(Next& next) noexcept
+{
+    next_ = &next;
+    next_allocate_ = [](void* a, std::size_t n) {
+        return static_cast<Next*>(a)->template allocate<alignment>(n);
+    };
+    next_deallocate_ = [](void* a, char* p, std::size_t n) {
+        static_cast<Next*>(a)->deallocate(p, n);
+    };
+    overflow_ = arena_overflow::chain;
+}
+
+template <std::size_t alignment>
 template <std::size_t ReqAlign>
-char* arena<N, alignment>::allocate(std::size_t n)
+char* arena_base<alignment>::allocate(std::size_t n)
 {
     static_assert(ReqAlign <= alignment, "alignment is too small for this arena");
 
@@ -62,22 +186,46 @@ char* arena<N, alignment>::allocate(std::size_t n)
     
     auto const aligned_n = align_up(n);
     
-    if (static_cast<decltype(aligned_n)>(buf_ + N - ptr_) >= aligned_n)
+    if (static_cast<std::size_t>(end_ - ptr_) >= aligned_n)
     {
         char* r = ptr_;
         ptr_ += aligned_n;
+        SHORT_ALLOC_UNPOISON(r, aligned_n);
+        ++stats_.hits;
+        if (used() > stats_.peak_used)
+            stats_.peak_used = used();
         return r;
     }
 
-    static_assert(alignment <= alignof(std::max_align_t), "you've chosen an "
-                  "alignment that is larger than alignof(std::max_align_t), and "
-                  "cannot be guaranteed by normal operator new");
+    return overflow_allocate(n);
+}
+
+template <std::size_t alignment>
+char* arena_base<alignment>::overflow_allocate(std::size_t n)
+{
+    ++stats_.overflows;
+    stats_.overflow_bytes += n;
 
-    return static_cast<char*>(::operator new(n));
+    switch (overflow_)
+    {
+    case arena_overflow::chain:
+        if (next_)
+            return next_allocate_(next_, n);
+        break;
+    case arena_overflow::throw_bad_alloc:
+        throw std::bad_alloc{};
+    case arena_overflow::abort_in_debug:
+        assert(!"arena overflowed in a no-heap section");
+        break;
+    case arena_overflow::heap:
+        break;
+    }
+
+    return heap_allocate(n);
 }
 
-template <std::size_t N, std::size_t alignment>
-void arena<N, alignment>::deallocate(char* p, std::size_t n) noexcept
+template <std::size_t alignment>
+void arena_base<alignment>::deallocate(char* p, std::size_t n) noexcept
 {
     assert(pointer_in_buffer(ptr_) && "short_alloc has outlived arena");
 
@@ -85,20 +233,66 @@ void arena<N, alignment>::deallocate(char* p, std::size_t n) noexcept
     {
         n = align_up(n);
         if (p + n == ptr_)
-            ptr_ = p;
+            release(p);
+        else
+            stats_.wasted_bytes += n;
     }
+    else if (next_)
+        next_deallocate_(next_, p, n);
     else
-        ::operator delete(p);
+        heap_deallocate(p);
 }
 
-template <class T, std::size_t N, std::size_t Align = alignof(std::max_align_t)>
+template <std::size_t alignment>
+void arena_base<alignment>::rewind(arena_marker m) noexcept
+{
+    assert(pointer_in_buffer(m.ptr) && "marker is from another arena");
+
+    // LIFO frees may already have taken ptr_ below the mark
+    if (m.ptr < ptr_)
+        release(m.ptr);
+    stats_.wasted_bytes = m.wasted_bytes;
+}
+
+// Rewinds the arena to where it was when the scope was entered
+//
+//   arena_scope<arena<4096>> frame{a};
+template <class Arena>
+class arena_scope
+{
+    Arena& a_;
+    arena_marker m_;
+
+public:
+    explicit arena_scope(Arena& a) noexcept : a_(a), m_(a.mark()) {}
+    ~arena_scope() {a_.rewind(m_);}
+    arena_scope(const arena_scope&) = delete;
+    arena_scope& operator=(const arena_scope&) = delete;
+};
+
+template <std::size_t N, std::size_t alignment = alignof(std::max_align_t)>
+class arena
+    : public arena_base<alignment>
+{
+    alignas(alignment) char buf_[N];
+
+public:
+    arena() noexcept : arena_base<alignment>(buf_, N) {}
+
+    static constexpr std::size_t size() noexcept {return N;}
+};
+
+// Arena may be any class template with arena's allocate/deallocate interface,
+// e.g. slab_arena from slab_arena.hh.
+template <class T, std::size_t N, std::size_t Align = alignof(std::max_align_t),
+          template <std::size_t, std::size_t> class Arena = arena>
 class short_alloc
 {
 public:
     using value_type = T;
     static auto constexpr alignment = Align;
     static auto constexpr size = N;
-    using arena_type = arena<size, alignment>;
+    using arena_type = Arena<size, alignment>;
 
 private:
     arena_type& a_;
@@ -114,10 +308,10 @@ public:
     }
     
     template <class U>
-        short_alloc(const short_alloc<U, N, alignment>& a) noexcept
+        short_alloc(const short_alloc<U, N, alignment, Arena>& a) noexcept
         : a_(a.a_) {}
 
-    template <class _Up> struct rebind {using other = short_alloc<_Up, N, alignment>;};
+    template <class _Up> struct rebind {using other = short_alloc<_Up, N, alignment, Arena>;};
 
     T* allocate(std::size_t n)
     {
@@ -130,26 +324,30 @@ public:
     }
 
     template <class T1, std::size_t N1, std::size_t A1,
-             class U, std::size_t M, std::size_t A2>
+             class U, std::size_t M, std::size_t A2,
+             template <std::size_t, std::size_t> class Ar>
                  friend
                  bool
-                 operator==(const short_alloc<T1, N1, A1>& x, const short_alloc<U, M, A2>& y) noexcept;
+                 operator==(const short_alloc<T1, N1, A1, Ar>& x, const short_alloc<U, M, A2, Ar>& y) noexcept;
 
-    template <class U, std::size_t M, std::size_t A> friend class short_alloc;
+    template <class U, std::size_t M, std::size_t A, template <std::size_t, std::size_t> class Ar>
+        friend class short_alloc;
 };
 
-template <class T, std::size_t N, std::size_t A1, class U, std::size_t M, std::size_t A2>
+template <class T, std::size_t N, std::size_t A1, class U, std::size_t M, std::size_t A2,
+          template <std::size_t, std::size_t> class Ar>
 inline
 bool
-operator==(const short_alloc<T, N, A1>& x, const short_alloc<U, M, A2>& y) noexcept
+operator==(const short_alloc<T, N, A1, Ar>& x, const short_alloc<U, M, A2, Ar>& y) noexcept
 {
     return N == M && A1 == A2 && &x.a_ == &y.a_;
 }
 
-template <class T, std::size_t N, std::size_t A1, class U, std::size_t M, std::size_t A2>
+template <class T, std::size_t N, std::size_t A1, class U, std::size_t M, std::size_t A2,
+          template <std::size_t, std::size_t> class Ar>
 inline
 bool
-operator!=(const short_alloc<T, N, A1>& x, const short_alloc<U, M, A2>& y) noexcept
+operator!=(const short_alloc<T, N, A1, Ar>& x, const short_alloc<U, M, A2, Ar>& y) noexcept
 {
     return !(x == y);
 }
@@ -0,0 +1,208 @@
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "arena_pool.hh"
+#include "alloc_counter.hh"
+#include "bench.hh"
+#include "short_alloc.hh"
+#include "slab_arena.hh"
+#include "mmap_arena.hh"
+
+/* Arena size for the request path workload */
+constexpr std::size_t arena_bytes = 256 * 1024;
+
+/**
+ * Request-path style churn: a map of strings with inserts and erases in
+ * random order plus a vector that is regularly cleared. Nothing is freed
+ * in LIFO order.
+ */
+template<typename Alloc, typename Make>
+void workload(Make make_alloc, std::mt19937 & g, std::size_t rounds)
+{
+    using char_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<char>;
+    using int_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<int>;
+    using str = std::basic_string<char, std::char_traits<char>, char_alloc>;
+    using pair_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<std::pair<int const, str>>;
+    using map = std::map<int, str, std::less<int>, pair_alloc>;
+
+    char_alloc a = make_alloc();
+    map m{pair_alloc{a}};
+    std::vector<int, int_alloc> v{int_alloc{a}};
+
+    for (std::size_t i = 0; i < rounds; ++i)
+    {
+        auto k = static_cast<int>(g() % 256);
+        if (g() % 2)
+            m.emplace(k, str(24 + g() % 100, 'x', a));
+        else
+            m.erase(k);
+
+        if (v.size() < 512)
+            v.push_back(k);
+        else
+            v.clear();
+    }
+}
+
+/* Arena size for one request of the per-request workload */
+constexpr std::size_t request_arena_bytes = 64 * 1024;
+
+/**
+ * One request: a hash map and a vector of temporaries, built up and then
+ * dropped as a whole
+ */
+template<typename Alloc>
+int request(Alloc const & a, std::mt19937 & g)
+{
+    using int_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<int>;
+    using pair_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<std::pair<int const, int>>;
+
+    std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, pair_alloc> m{0, std::hash<int>{},
+                                                                                   std::equal_to<int>{}, pair_alloc{a}};
+    std::vector<int, int_alloc> v{int_alloc{a}};
+
+    for (int i = 0; i < 256; ++i)
+    {
+        auto k = static_cast<int>(g() % 1024);
+        m[k] += i;
+        v.push_back(k);
+    }
+
+    int sum = 0;
+    for (auto k : v)
+        sum += m[k];
+    return sum;
+}
+
+int main(int argc, char ** argv)
+{
+    bench::reporter rep{bench::parse_args(argc, argv)};
+    std::mt19937 g{std::random_device{}()};
+    constexpr std::size_t rounds = 20000;
+
+    /* Times run_once, counting only the heap allocations it makes */
+    auto measure = [&](std::string const & name, std::function<void()> reset,
+                       std::function<void()> run_once,
+                       std::function<arena_stats()> stats = nullptr) {
+        if (!rep.wanted(name))
+            return;
+
+        std::size_t heap = 0;
+        auto r = bench::run(name, {}, rep.opts(), rounds, reset, [&] {
+            auto before = heap_allocations;
+            run_once();
+            heap += heap_allocations - before;
+        });
+
+        r.params.emplace_back("heap_allocs_per_run",
+                              std::to_string(heap / (rep.opts().runs + rep.opts().warmup)));
+
+        /* Arena counters of the last run */
+        if (stats) {
+            auto s = stats();
+            r.params.emplace_back("hits", std::to_string(s.hits));
+            r.params.emplace_back("overflows", std::to_string(s.overflows));
+            r.params.emplace_back("overflow_bytes", std::to_string(s.overflow_bytes));
+            r.params.emplace_back("peak_used", std::to_string(s.peak_used));
+            r.params.emplace_back("wasted_bytes", std::to_string(s.wasted_bytes));
+        }
+
+        rep.add(std::move(r));
+    };
+
+    measure("std::allocator", [] {}, [&] {
+        workload<std::allocator<char>>([] { return std::allocator<char>{}; }, g, rounds);
+    });
+
+    using short_type = short_alloc<char, arena_bytes>;
+    auto short_arena = std::unique_ptr<short_type::arena_type>{new short_type::arena_type{}};
+    measure("short_alloc", [&] { short_arena->reset(); short_arena->reset_stats(); }, [&] {
+        workload<short_type>([&] { return short_type{*short_arena}; }, g, rounds);
+    }, [&] { return short_arena->stats(); });
+
+    /* Small primary arena spilling into a slab arena instead of the heap */
+    using chained_type = short_alloc<char, arena_bytes / 16>;
+    auto chained = std::unique_ptr<chained_type::arena_type>{new chained_type::arena_type{}};
+    auto secondary = std::unique_ptr<slab_alloc<char, arena_bytes>::arena_type>{
+        new slab_alloc<char, arena_bytes>::arena_type{}};
+    chained->chain(*secondary);
+    measure("short_alloc (chained to slab_arena)", [&] {
+        chained->reset();
+        chained->reset_stats();
+        secondary->reset();
+    }, [&] {
+        workload<chained_type>([&] { return chained_type{*chained}; }, g, rounds);
+    }, [&] { return chained->stats(); });
+
+    using slab_type = slab_alloc<char, arena_bytes>;
+    auto slab = std::unique_ptr<slab_type::arena_type>{new slab_type::arena_type{}};
+    slab->set_overflow(arena_overflow::throw_bad_alloc);
+    measure("slab_alloc", [&] { slab->reset(); slab->reset_stats(); }, [&] {
+        workload<slab_type>([&] { return slab_type{*slab}; }, g, rounds);
+    }, [&] { return slab->stats(); });
+
+    /* Per-request temporaries: malloc vs a pooled arena vs a scope rewind */
+    constexpr std::size_t requests = rounds / 200;
+    volatile int sink = 0;
+
+    measure("requests std::allocator", [] {}, [&] {
+        for (std::size_t r = 0; r < requests; ++r)
+            sink = request(std::allocator<char>{}, g);
+    });
+
+    using request_type = short_alloc<char, request_arena_bytes>;
+    using request_pool = thread_arena_pool<request_type::arena_type>;
+    measure("requests thread_arena_pool", [] {}, [&] {
+        for (std::size_t r = 0; r < requests; ++r) {
+            auto lease = request_pool::acquire();
+            sink = request(request_type{*lease}, g);
+        }
+    });
+
+    auto request_arena = std::unique_ptr<request_type::arena_type>{new request_type::arena_type{}};
+    measure("requests arena_scope", [&] { request_arena->reset_stats(); }, [&] {
+        for (std::size_t r = 0; r < requests; ++r) {
+            arena_scope<request_type::arena_type> frame{*request_arena};
+            sink = request(request_type{*request_arena}, g);
+        }
+    }, [&] { return request_arena->stats(); });
+
+    /* Cache-line aligned SIMD scratch, a fresh set of buffers per round */
+    constexpr std::size_t scratch_bytes = 16 * 1024;
+    constexpr std::size_t scratch_buffers = 64;
+
+    auto scratch = [&](auto get, auto put) {
+        for (std::size_t r = 0; r < rounds / 100; ++r)
+        {
+            float * bufs[scratch_buffers];
+            for (auto & b : bufs) {
+                b = get();
+                b[0] = b[scratch_bytes / sizeof(float) - 1] = static_cast<float>(r);
+            }
+            for (auto i = scratch_buffers; i-- > 0;)
+                put(bufs[i]);
+        }
+    };
+
+    measure("aligned operator new (64)", [] {}, [&] {
+        scratch([] { return static_cast<float *>(::operator new(scratch_bytes, std::align_val_t{64})); },
+                [](float * p) { ::operator delete(p, std::align_val_t{64}); });
+    });
+
+    mmap_arena<64> scratch_arena{scratch_bytes * scratch_buffers, true};
+    scratch_arena.set_overflow(arena_overflow::throw_bad_alloc);
+    measure(std::string{"mmap_arena<64>"} + (scratch_arena.huge_pages() ? " (hugetlb)" : " (thp)"),
+            [&] { scratch_arena.reset_stats(); }, [&] {
+        scratch([&] { return reinterpret_cast<float *>(scratch_arena.allocate<64>(scratch_bytes)); },
+                [&](float * p) { scratch_arena.deallocate(reinterpret_cast<char *>(p), scratch_bytes); });
+    }, [&] { return scratch_arena.stats(); });
+
+    rep.print(std::cout);
+}
@@ -0,0 +1,183 @@
+#ifndef SLAB_ARENA_H
+#define SLAB_ARENA_H
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+
+#include "short_alloc.hh"
+
+// Size-class layer over arena.
+//
+// arena only takes memory back when it is the most recent allocation, so
+// containers freeing out of order leak buffer space and end up on the heap.
+// slab_arena rounds small requests up to a size class and keeps one free
+// list per class inside the arena buffer, so any freed block is reused by
+// the next request of the same class. Classes follow jemalloc: multiples of
+// the quantum up to 4 quanta, then four classes per doubling (5/4, 6/4, 7/4
+// and 8/4 of the previous power of two). Requests over MaxClass go straight
+// to the arena.
+//
+//   slab_arena<4096> a;
+//   std::map<int, int, std::less<int>, slab_alloc<std::pair<const int, int>, 4096>> m{a};
+
+template <std::size_t quantum>
+struct slab_size_classes
+{
+    static_assert((quantum & (quantum - 1)) == 0, "alignment must be a power of two");
+
+    // Index of n > base, where base is a power of two starting class group idx
+    static constexpr std::size_t large_index(std::size_t n, std::size_t base, std::size_t idx) noexcept
+    {
+        return n <= 2 * base ? idx + (n - base + base / 4 - 1) / (base / 4) - 1
+                             : large_index(n, 2 * base, idx + 4);
+    }
+
+    static constexpr std::size_t index(std::size_t n) noexcept
+    {
+        return n <= 4 * quantum ? (n ? (n - 1) / quantum : 0)
+                                : large_index(n, 4 * quantum, 4);
+    }
+
+    static constexpr std::size_t size(std::size_t idx) noexcept
+    {
+        return idx < 4 ? (idx + 1) * quantum
+                       : (4 * quantum << ((idx - 4) / 4)) +
+                         ((4 * quantum << ((idx - 4) / 4)) / 4) * ((idx - 4) % 4 + 1);
+    }
+};
+
+template <std::size_t N, std::size_t alignment = alignof(std::max_align_t),
+          std::size_t MaxClass = 4096>
+class slab_arena
+{
+public:
+    // Free blocks hold a next pointer, so nothing is smaller than one
+    static constexpr std::size_t quantum =
+        alignment > sizeof(char*) ? alignment : sizeof(char*);
+
+    using classes = slab_size_classes<quantum>;
+
+    static_assert(MaxClass >= 4 * quantum, "MaxClass must cover the small classes");
+
+    static constexpr std::size_t class_index(std::size_t n) noexcept {return classes::index(n);}
+    static constexpr std::size_t class_size(std::size_t idx) noexcept {return classes::size(idx);}
+
+    static constexpr std::size_t num_classes = classes::index(MaxClass) + 1;
+    static constexpr std::size_t max_class = classes::size(num_classes - 1);
+
+private:
+    arena<N, alignment> a_;
+    char* free_[num_classes];
+    std::size_t reused_ = 0;  // allocations served from the free lists
+
+    static char* next_of(char* p) noexcept
+    {
+        char* next;
+        std::memcpy(&next, p, sizeof(next));
+        return next;
+    }
+
+    static void set_next(char* p, char* next) noexcept
+    {
+        std::memcpy(p, &next, sizeof(next));
+    }
+
+    char* pop(std::size_t idx) noexcept
+    {
+        char* r = free_[idx];
+        if (r)
+            free_[idx] = next_of(r);
+        return r;
+    }
+
+public:
+    ~slab_arena() = default;
+    slab_arena() noexcept {clear_free_lists();}
+    slab_arena(const slab_arena&) = delete;
+    slab_arena& operator=(const slab_arena&) = delete;
+
+    template <std::size_t ReqAlign> char* allocate(std::size_t n);
+    void deallocate(char* p, std::size_t n) noexcept;
+
+    static constexpr std::size_t size() noexcept {return N;}
+    std::size_t used() const noexcept {return a_.used();}
+    void reset() noexcept {a_.reset(); clear_free_lists();}
+    bool owns(const char* p) const noexcept {return a_.owns(p);}
+
+    // Free list reuse counts as a hit, nothing is wasted by out of order frees
+    arena_stats stats() const noexcept
+    {
+        auto s = a_.stats();
+        s.hits += reused_;
+        return s;
+    }
+    void reset_stats() noexcept {a_.reset_stats(); reused_ = 0;}
+
+    arena_overflow overflow() const noexcept {return a_.overflow();}
+    void set_overflow(arena_overflow o) noexcept {a_.set_overflow(o);}
+    template <class Next> void chain(Next& next) noexcept {a_.chain(next);}
+
+private:
+    void clear_free_lists() noexcept
+    {
+        for (auto& f : free_)
+            f = nullptr;
+    }
+};
+
+template <std::size_t N, std::size_t alignment, std::size_t MaxClass>
+template <std::size_t ReqAlign>
+char* slab_arena<N, alignment, MaxClass>::allocate(std::size_t n)
+{
+    static_assert(ReqAlign <= alignment, "alignment is too small for this arena");
+
+    if (n > max_class)
+        return a_.template allocate<ReqAlign>(n);
+
+    auto const idx = class_index(n);
+
+    if (char* r = pop(idx))
+    {
+        ++reused_;
+        return r;
+    }
+
+    // Carve a fresh block while the buffer lasts
+    if (class_size(idx) <= N - a_.used())
+        return a_.template allocate<ReqAlign>(class_size(idx));
+
+    // Out of buffer, a bigger free block beats the heap
+    for (auto i = idx + 1; i < num_classes; ++i)
+        if (char* r = pop(i))
+        {
+            ++reused_;
+            return r;
+        }
+
+    return a_.template allocate<ReqAlign>(class_size(idx));
+}
+
+template <std::size_t N, std::size_t alignment, std::size_t MaxClass>
+void slab_arena<N, alignment, MaxClass>::deallocate(char* p, std::size_t n) noexcept
+{
+    if (n > max_class || !a_.owns(p))
+    {
+        a_.deallocate(p, n > max_class ? n : class_size(class_index(n)));
+        return;
+    }
+
+    // A borrowed bigger block just becomes a block of this class
+    auto const idx = class_index(n);
+    set_next(p, free_[idx]);
+    free_[idx] = p;
+}
+
+// slab_arena defaults MaxClass, which short_alloc's Arena parameter can't name
+template <std::size_t N, std::size_t alignment>
+using default_slab_arena = slab_arena<N, alignment>;
+
+template <class T, std::size_t N, std::size_t Align = alignof(std::max_align_t)>
+using slab_alloc = short_alloc<T, N, Align, default_slab_arena>;
+
+#endif  // SLAB_ARENA_H
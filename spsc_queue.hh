@@ -0,0 +1,213 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "wait_strategy.hh"
+
+/**
+ * @brief Bounded wait-free single producer single consumer queue
+ * @tparam T Element type, constructible from nullptr for terminate()
+ * @tparam Capacity Number of slots, a power of two
+ * @tparam Wait How an empty or full ring is waited on, see wait_strategy.hh
+ * @details Same surface as Queue and mpmc_queue, for exactly one pushing
+ *          and one popping thread. Each side owns one index and only
+ *          publishes it with a release store. It also keeps a cached copy
+ *          of the other side's index and only reloads that (a cache line
+ *          the other core is writing) when the cached value says full or
+ *          empty.
+ *
+ *          push_n()/pop_n() move up to n items for a single index
+ *          publication, so the other side sees one cache line transfer per
+ *          batch instead of one per item.
+ *
+ *          push() and wait_and_pop() wait with the Wait strategy.
+ */
+template<typename T, std::size_t Capacity, typename Wait = spin_then_yield>
+class spsc_queue final
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+public:
+    /**< Underlaying type */
+    using type = T;
+    /**< Queue type */
+    using data_type = T;
+    /**< Termination type */
+    using terminator = std::nullptr_t;
+
+private:
+    static constexpr std::size_t cache_line = 64;
+    static constexpr std::size_t mask = Capacity - 1;
+
+    using slot_type = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    /**< Producer's line: next position to push to, last seen head */
+    alignas(cache_line) std::atomic<std::size_t> m_tail;
+    std::size_t m_cached_head;
+    /**< Consumer's line: next position to pop from, last seen tail */
+    alignas(cache_line) std::atomic<std::size_t> m_head;
+    std::size_t m_cached_tail;
+    /**< Consumers waiting for items, producers waiting for room */
+    alignas(cache_line) Wait m_not_empty;
+    alignas(cache_line) Wait m_not_full;
+    /**< The ring */
+    alignas(cache_line) slot_type m_slots[Capacity];
+
+    T * slot(std::size_t pos) { return reinterpret_cast<T *>(&m_slots[pos & mask]); }
+
+    /* Room for up to n more, producer side */
+    std::size_t free_slots(std::size_t tail, std::size_t n)
+    {
+        if (Capacity - (tail - m_cached_head) < n)
+            m_cached_head = m_head.load(std::memory_order_acquire);
+        return Capacity - (tail - m_cached_head);
+    }
+
+    /* Items ready, up to n wanted, consumer side */
+    std::size_t ready_slots(std::size_t head, std::size_t n)
+    {
+        if (m_cached_tail - head < n)
+            m_cached_tail = m_tail.load(std::memory_order_acquire);
+        return m_cached_tail - head;
+    }
+
+    template<typename U>
+    bool try_emplace(U && value)
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        if (free_slots(tail, 1) == 0)
+            return false;
+
+        new (slot(tail)) T(std::forward<U>(value));
+        m_tail.store(tail + 1, std::memory_order_release);
+        m_not_empty.notify_one();
+        return true;
+    }
+
+public:
+    spsc_queue() :
+        m_tail{0},
+        m_cached_head{0},
+        m_head{0},
+        m_cached_tail{0}
+    {}
+
+    spsc_queue(spsc_queue const &) = delete;
+    spsc_queue & operator=(spsc_queue const &) = delete;
+
+    ~spsc_queue()
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        for (auto head = m_head.load(std::memory_order_relaxed); head != tail; ++head)
+            slot(head)->~T();
+    }
+
+    /**
+     * @brief Pushes without waiting
+     * @return false when the ring is full, value is left untouched (it is
+     *          only moved from once a slot is claimed)
+     */
+    bool try_push(T const & value) { return try_emplace(value); }
+    bool try_push(T && value) { return try_emplace(std::move(value)); }
+
+    /**
+     * @brief Pops without waiting
+     * @return false when the ring is empty
+     */
+    bool try_pop(T & value)
+    {
+        auto head = m_head.load(std::memory_order_relaxed);
+        if (ready_slots(head, 1) == 0)
+            return false;
+
+        auto * p = slot(head);
+        value = std::move(*p);
+        p->~T();
+        m_head.store(head + 1, std::memory_order_release);
+        m_not_full.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Pushes as many of items[0, n) as there is room for
+     * @return How many were pushed, published with one index store
+     */
+    std::size_t push_n(T const * items, std::size_t n)
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        auto count = std::min(n, free_slots(tail, n));
+
+        for (std::size_t i = 0; i < count; ++i)
+            new (slot(tail + i)) T(items[i]);
+
+        if (count) {
+            m_tail.store(tail + count, std::memory_order_release);
+            m_not_empty.notify_one();
+        }
+        return count;
+    }
+
+    /**
+     * @brief Pops up to n items into out
+     * @return How many were popped, released with one index store
+     */
+    std::size_t pop_n(T * out, std::size_t n)
+    {
+        auto head = m_head.load(std::memory_order_relaxed);
+        auto count = std::min(n, ready_slots(head, n));
+
+        for (std::size_t i = 0; i < count; ++i) {
+            auto * p = slot(head + i);
+            out[i] = std::move(*p);
+            p->~T();
+        }
+
+        if (count) {
+            m_head.store(head + count, std::memory_order_release);
+            m_not_full.notify_one();
+        }
+        return count;
+    }
+
+    /* Queue's interface, nullptr when empty */
+    data_type try_pop()
+    {
+        data_type value = terminator();
+        try_pop(value);
+        return value;
+    }
+
+    data_type wait_and_pop()
+    {
+        data_type value = terminator();
+        m_not_empty.wait([&] { return try_pop(value); });
+        return value;
+    }
+
+    /* Waits for room when the ring is full */
+    void push(T new_value)
+    {
+        m_not_full.wait([&] { return try_emplace(std::move(new_value)); });
+    }
+
+    void terminate() { push(terminator()); }
+
+    /* Approximate unless called from the producer or consumer */
+    std::size_t size() const
+    {
+        auto head = m_head.load(std::memory_order_acquire);
+        auto tail = m_tail.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    static constexpr std::size_t capacity() { return Capacity; }
+};
+
+#endif  // SPSC_QUEUE_H
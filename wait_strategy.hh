@@ -0,0 +1,171 @@
+#ifndef WAIT_STRATEGY_H
+#define WAIT_STRATEGY_H
+
+#include <atomic>
+#include <cstdint>
+
+#ifdef __linux__
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#include "backoff.hh"
+
+/**
+ * How a queue side waits for the other side: consumers for items, producers
+ * for room. A strategy has
+ *
+ *   template<typename Ready> void wait(Ready ready);  calls ready() until it
+ *                                                     is true, ready() may be
+ *                                                     a try_pop
+ *   void notify_one();                                after publishing
+ *   void notify_all();
+ *
+ * busy_spin          pause in a loop, lowest latency, burns a core per waiter
+ * spin_then_yield    pause for a while, then yield (the default, backoff)
+ * spin_then_park<N>  pause N rounds, then sleep on a futex
+ * blocking           sleep on a futex right away
+ *
+ * Parking strategies count their sleepers, notify is a fence and a load
+ * unless somebody is actually parked.
+ */
+
+struct busy_spin
+{
+    template<typename Ready>
+    void wait(Ready ready)
+    {
+        while (!ready())
+            cpu_relax();
+    }
+
+    void notify_one() {}
+    void notify_all() {}
+};
+
+struct spin_then_yield
+{
+    template<typename Ready>
+    void wait(Ready ready)
+    {
+        backoff b;
+        while (!ready())
+            b.pause();
+    }
+
+    void notify_one() {}
+    void notify_all() {}
+};
+
+/**
+ * @brief Event count: lets a thread sleep until the condition it checks may
+ *          have changed, without a lock around the condition
+ * @details The waiter announces itself, takes the epoch and checks the
+ *          condition again before sleeping on the epoch. A notifier that
+ *          published after that check bumps the epoch, so the sleep returns
+ *          at once, and one that published before it is seen by the check.
+ */
+class parker
+{
+private:
+    std::atomic<std::uint32_t> m_epoch{0};
+    std::atomic<std::uint32_t> m_waiters{0};
+
+#ifndef __linux__
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+#endif
+
+    void sleep(std::uint32_t epoch)
+    {
+#ifdef __linux__
+        ::syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&m_epoch), FUTEX_WAIT_PRIVATE,
+                  epoch, nullptr, nullptr, 0);
+#else
+        std::unique_lock<std::mutex> lk{m_mutex};
+        m_cv.wait(lk, [&] { return m_epoch.load() != epoch; });
+#endif
+    }
+
+    void wake(int count)
+    {
+#ifdef __linux__
+        ::syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&m_epoch), FUTEX_WAKE_PRIVATE,
+                  count, nullptr, nullptr, 0);
+#else
+        std::lock_guard<std::mutex> lk{m_mutex};
+        if (count == 1)
+            m_cv.notify_one();
+        else
+            m_cv.notify_all();
+#endif
+    }
+
+    void notify(int count)
+    {
+        /* Orders the caller's publish before reading m_waiters, pairs with
+         * the waiter's increment before its last check */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed) == 0)
+            return;
+
+        m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        wake(count);
+    }
+
+public:
+    template<typename Ready>
+    void wait(Ready ready)
+    {
+        /* ready() may consume what it finds, call it once per success */
+        while (!ready())
+        {
+            m_waiters.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto epoch = m_epoch.load(std::memory_order_seq_cst);
+
+            bool done = ready();
+            if (!done)
+                sleep(epoch);
+
+            m_waiters.fetch_sub(1, std::memory_order_relaxed);
+            if (done)
+                return;
+        }
+    }
+
+    void notify_one() { notify(1); }
+    void notify_all() { notify(INT_MAX); }
+};
+
+template<unsigned Spins = 1000>
+class spin_then_park
+{
+private:
+    parker m_parker;
+
+public:
+    template<typename Ready>
+    void wait(Ready ready)
+    {
+        for (unsigned i = 0; i < Spins; ++i) {
+            if (ready())
+                return;
+            cpu_relax();
+        }
+
+        m_parker.wait(ready);
+    }
+
+    void notify_one() { m_parker.notify_one(); }
+    void notify_all() { m_parker.notify_all(); }
+};
+
+using blocking = spin_then_park<0>;
+
+#endif  // WAIT_STRATEGY_H
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hh"
+#include "spsc_queue.hh"
+#include "work_stealing_pool.hh"
+
+/**
+ * MyObject processing spread over threads: a fixed reader/writer pair per
+ * queue with the objects split evenly between queues, against the
+ * work-stealing pool. The first eighth of the objects cost 16x the rest, so
+ * the static split leaves one queue with most of the work.
+ */
+
+/* example object, as in queue_test_placement_new.cc */
+struct MyObject { /* just some data */ char c[64]; };
+
+constexpr std::size_t objects = 20000;
+constexpr unsigned light_rounds = 4;
+constexpr unsigned heavy_rounds = light_rounds * 16;
+
+unsigned rounds_for(std::size_t i)
+{
+    return i < objects / 8 ? heavy_rounds : light_rounds;
+}
+
+/* Some hashing over the object's bytes */
+void process(MyObject & o, unsigned rounds)
+{
+    std::uint64_t h = 1469598103934665603ull;
+    for (unsigned r = 0; r < rounds; ++r)
+        for (auto c : o.c)
+            h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    o.c[0] = static_cast<char>(h);
+}
+
+/* Every object, once per run */
+std::uint64_t checksum(std::vector<MyObject> const & objs)
+{
+    std::uint64_t s = 0;
+    for (auto const & o : objs)
+        s += static_cast<unsigned char>(o.c[0]);
+    return s;
+}
+
+int main(int argc, char ** argv)
+{
+    bench::reporter rep{bench::parse_args(argc, argv)};
+
+    auto threads = std::max<std::size_t>(2, std::thread::hardware_concurrency());
+    std::vector<MyObject> objs(objects);
+    volatile std::uint64_t sink = 0;
+
+    bench::params params = {{"threads", std::to_string(threads)},
+                            {"objects", std::to_string(objects)}};
+
+    /* Half the threads write, half read, one queue per pair */
+    if (rep.wanted("thread per queue"))
+    {
+        auto pairs = std::max<std::size_t>(1, threads / 2);
+        using queue_type = spsc_queue<MyObject *, 1024>;
+
+        auto p = params;
+        p.emplace_back("queues", std::to_string(pairs));
+
+        rep.add(bench::run("thread per queue", p, rep.opts(), objects, [&] {
+            std::vector<std::unique_ptr<queue_type>> queues;
+            std::vector<std::thread> workers;
+
+            for (std::size_t q = 0; q < pairs; ++q)
+                queues.emplace_back(new queue_type{});
+
+            for (std::size_t q = 0; q < pairs; ++q)
+            {
+                auto begin = objects * q / pairs, end = objects * (q + 1) / pairs;
+
+                workers.emplace_back([&, q] {
+                    while (MyObject * o = queues[q]->wait_and_pop())
+                        process(*o, rounds_for(static_cast<std::size_t>(o - objs.data())));
+                });
+
+                workers.emplace_back([&, q, begin, end] {
+                    for (auto i = begin; i < end; ++i)
+                        queues[q]->push(&objs[i]);
+                    queues[q]->terminate();
+                });
+            }
+
+            for (auto & w : workers)
+                w.join();
+
+            sink = checksum(objs);
+        }));
+    }
+
+    work_stealing_pool pool{threads};
+
+    if (rep.wanted("work_stealing_pool task per object"))
+    {
+        rep.add(bench::run("work_stealing_pool task per object", params, rep.opts(), objects, [&] {
+            {
+                task_group g{pool};
+                for (std::size_t i = 0; i < objects; ++i)
+                    g.run([&objs, i] { process(objs[i], rounds_for(i)); });
+            }
+
+            sink = checksum(objs);
+        }));
+    }
+
+    for (std::size_t grain : {16, 256})
+    {
+        auto name = "work_stealing_pool parallel_for";
+        if (!rep.wanted(name))
+            continue;
+
+        auto p = params;
+        p.emplace_back("grain", std::to_string(grain));
+
+        rep.add(bench::run(name, p, rep.opts(), objects, [&] {
+            pool.parallel_for(0, objects, grain, [&](std::size_t i) {
+                process(objs[i], rounds_for(i));
+            });
+
+            sink = checksum(objs);
+        }));
+    }
+
+    rep.print(std::cout);
+}
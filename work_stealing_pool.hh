@@ -0,0 +1,387 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "backoff.hh"
+#include "mpmc_queue.hh"
+#include "wait_strategy.hh"
+
+/**
+ * @brief Chase-Lev work-stealing deque
+ * @details The owner pushes and pops at the bottom without contention,
+ *          thieves take from the top with a CAS, which only the last item
+ *          contends on. The ring doubles when full; old rings are kept
+ *          until the deque goes since a thief may still be reading one.
+ *          Memory orders follow Le, Pop, Cohen and Zappa Nardelli,
+ *          "Correct and Efficient Work-Stealing for Weak Memory Models".
+ * @tparam T Trivially copyable element, pointers in practice
+ */
+template<typename T>
+class chase_lev_deque
+{
+private:
+    static constexpr std::size_t cache_line = 64;
+
+    struct ring
+    {
+        std::int64_t size;
+        std::unique_ptr<std::atomic<T>[]> items;
+
+        explicit ring(std::int64_t n) : size{n}, items{new std::atomic<T>[n]} {}
+
+        T get(std::int64_t i) const { return items[i & (size - 1)].load(std::memory_order_relaxed); }
+        void put(std::int64_t i, T x) { items[i & (size - 1)].store(x, std::memory_order_relaxed); }
+    };
+
+    alignas(cache_line) std::atomic<std::int64_t> m_top{0};
+    alignas(cache_line) std::atomic<std::int64_t> m_bottom{0};
+    std::atomic<ring *> m_ring;
+    /**< Every ring ever used, owner only */
+    std::vector<std::unique_ptr<ring>> m_rings;
+
+    ring * grow(ring * r, std::int64_t top, std::int64_t bottom)
+    {
+        m_rings.emplace_back(new ring{r->size * 2});
+        auto * bigger = m_rings.back().get();
+
+        for (auto i = top; i < bottom; ++i)
+            bigger->put(i, r->get(i));
+
+        m_ring.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+public:
+    explicit chase_lev_deque(std::int64_t capacity = 256)
+    {
+        m_rings.emplace_back(new ring{capacity});
+        m_ring.store(m_rings.back().get(), std::memory_order_relaxed);
+    }
+
+    chase_lev_deque(chase_lev_deque const &) = delete;
+    chase_lev_deque& operator=(chase_lev_deque const &) = delete;
+
+    /* Owner only */
+    void push(T x)
+    {
+        auto b = m_bottom.load(std::memory_order_relaxed);
+        auto t = m_top.load(std::memory_order_acquire);
+        auto * r = m_ring.load(std::memory_order_relaxed);
+
+        if (b - t > r->size - 1)
+            r = grow(r, t, b);
+
+        r->put(b, x);
+        m_bottom.store(b + 1, std::memory_order_release);
+    }
+
+    /* Owner only, newest first */
+    bool pop(T & x)
+    {
+        auto b = m_bottom.load(std::memory_order_relaxed) - 1;
+        auto * r = m_ring.load(std::memory_order_relaxed);
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto t = m_top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        x = r->get(b);
+        if (t < b)
+            return true;
+
+        /* Last item, race the thieves for it */
+        bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                 std::memory_order_relaxed);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    /* Any thread, oldest first. false when empty or another thief won */
+    bool steal(T & x)
+    {
+        auto t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto b = m_bottom.load(std::memory_order_acquire);
+
+        if (t >= b)
+            return false;
+
+        auto * r = m_ring.load(std::memory_order_acquire);
+        x = r->get(t);
+        return m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed);
+    }
+
+    /* Approximate unless called by the owner with no thieves around */
+    std::size_t size() const
+    {
+        auto b = m_bottom.load(std::memory_order_relaxed);
+        auto t = m_top.load(std::memory_order_relaxed);
+        return b > t ? static_cast<std::size_t>(b - t) : 0;
+    }
+};
+
+/**
+ * @brief Thread pool where each worker runs its own deque and steals from
+ *          the others when it runs dry
+ * @details Tasks submitted from a worker go to its own deque (LIFO for the
+ *          owner, so recursive splits stay cache warm), tasks from outside
+ *          go to a shared injection queue. An idle worker looks at its
+ *          deque, then the injection queue, then steals from random
+ *          victims, and finally parks until something is submitted.
+ *
+ *          work_stealing_pool pool;
+ *          task_group g{pool};
+ *          g.run([] { ... });
+ *          pool.parallel_for(0, n, 1024, [&](std::size_t i) { ... });
+ *          g.wait();
+ *
+ *          Tasks must not throw. Destroying the pool runs whatever is
+ *          still queued, then joins.
+ */
+class work_stealing_pool
+{
+public:
+    class group;
+
+private:
+    struct task
+    {
+        std::function<void()> fn;
+        group * owner;
+    };
+
+    /**< Shared queue for submissions from outside the pool */
+    static constexpr std::size_t injection_capacity = 4096;
+
+    struct worker
+    {
+        chase_lev_deque<task *> deque;
+        std::uint64_t rng;
+
+        explicit worker(std::uint64_t seed) : rng{seed} {}
+    };
+
+    std::vector<std::unique_ptr<worker>> m_workers;
+    std::unique_ptr<mpmc_queue<task *, injection_capacity>> m_injection;
+    /**< Idle workers park here */
+    parker m_idle;
+    std::atomic<bool> m_stopping{false};
+    std::vector<std::thread> m_threads;
+
+    /* Which pool and worker the calling thread is, if any */
+    struct context
+    {
+        work_stealing_pool * pool;
+        std::size_t index;
+    };
+
+    static context & current()
+    {
+        static thread_local context c{nullptr, 0};
+        return c;
+    }
+
+    worker * local_worker() const
+    {
+        auto & c = current();
+        return c.pool == this ? m_workers[c.index].get() : nullptr;
+    }
+
+    void enqueue(task * t)
+    {
+        if (auto * w = local_worker())
+            w->deque.push(t);
+        else
+            m_injection->push(t);
+
+        m_idle.notify_one();
+    }
+
+    /* Own deque, then the injection queue, then a round of stealing */
+    task * find_task(worker * self)
+    {
+        task * t = nullptr;
+
+        if (self && self->deque.pop(t))
+            return t;
+
+        if (m_injection->try_pop(t))
+            return t;
+
+        auto n = m_workers.size();
+        std::uint64_t r = self ? self->rng : reinterpret_cast<std::uintptr_t>(&t);
+        /* xorshift, victims in a random rotation */
+        r ^= r << 13; r ^= r >> 7; r ^= r << 17;
+        if (self)
+            self->rng = r;
+
+        for (std::size_t i = 0; i < n; ++i) {
+            auto & victim = *m_workers[(r + i) % n];
+            if (&victim != self && victim.deque.steal(t))
+                return t;
+        }
+
+        return nullptr;
+    }
+
+    void run(task * t);
+
+    void worker_main(std::size_t index)
+    {
+        current() = context{this, index};
+        auto * self = m_workers[index].get();
+
+        for (;;)
+        {
+            task * t = find_task(self);
+
+            if (!t) {
+                /* Spin a little before parking, stealing races are short */
+                for (int i = 0; i < 64 && !(t = find_task(self)); ++i)
+                    cpu_relax();
+
+                if (!t)
+                    m_idle.wait([&] {
+                        return (t = find_task(self)) != nullptr || m_stopping.load(std::memory_order_acquire);
+                    });
+
+                if (!t)
+                    return;
+            }
+
+            run(t);
+        }
+    }
+
+public:
+    /**
+     * @brief Tasks run together and waited on as one, see task_group
+     */
+    class group
+    {
+    private:
+        work_stealing_pool & m_pool;
+        std::atomic<std::size_t> m_pending{0};
+
+        friend class work_stealing_pool;
+
+    public:
+        explicit group(work_stealing_pool & pool) : m_pool{pool} {}
+        group(group const &) = delete;
+        group& operator=(group const &) = delete;
+        ~group() { wait(); }
+
+        template<typename F>
+        void run(F && fn)
+        {
+            m_pending.fetch_add(1, std::memory_order_relaxed);
+            m_pool.enqueue(new task{std::forward<F>(fn), this});
+        }
+
+        /* Runs pool tasks on the calling thread until the group is done */
+        void wait()
+        {
+            backoff b;
+            while (m_pending.load(std::memory_order_acquire) != 0)
+            {
+                if (auto * t = m_pool.find_task(m_pool.local_worker())) {
+                    m_pool.run(t);
+                    b.reset();
+                }
+                else
+                    b.pause();
+            }
+        }
+    };
+
+    explicit work_stealing_pool(std::size_t threads = std::thread::hardware_concurrency()) :
+        m_injection{new mpmc_queue<task *, injection_capacity>{}}
+    {
+        if (threads == 0)
+            threads = 1;
+
+        for (std::size_t i = 0; i < threads; ++i)
+            m_workers.emplace_back(new worker{0x9e3779b97f4a7c15ull * (i + 1)});
+
+        for (std::size_t i = 0; i < threads; ++i)
+            m_threads.emplace_back(&work_stealing_pool::worker_main, this, i);
+    }
+
+    work_stealing_pool(work_stealing_pool const &) = delete;
+    work_stealing_pool& operator=(work_stealing_pool const &) = delete;
+
+    ~work_stealing_pool()
+    {
+        m_stopping.store(true, std::memory_order_release);
+        m_idle.notify_all();
+
+        for (auto & t : m_threads)
+            t.join();
+    }
+
+    /* Fire and forget */
+    template<typename F>
+    void submit(F && fn)
+    {
+        enqueue(new task{std::forward<F>(fn), nullptr});
+    }
+
+    /**
+     * @brief Calls fn(i) for i in [begin, end), split down to grain sized
+     *          chunks that idle workers steal, returns when all are done
+     */
+    template<typename F>
+    void parallel_for(std::size_t begin, std::size_t end, std::size_t grain, F fn)
+    {
+        group g{*this};
+        split(g, begin, end, grain ? grain : 1, fn);
+        g.wait();
+    }
+
+    std::size_t size() const { return m_threads.size(); }
+
+private:
+    /* Hands off the upper halves, keeps the lowest chunk for itself */
+    template<typename F>
+    void split(group & g, std::size_t begin, std::size_t end, std::size_t grain, F & fn)
+    {
+        while (end - begin > grain)
+        {
+            auto mid = begin + (end - begin) / 2;
+            g.run([this, &g, mid, end, grain, &fn] { split(g, mid, end, grain, fn); });
+            end = mid;
+        }
+
+        for (auto i = begin; i < end; ++i)
+            fn(i);
+    }
+};
+
+inline void work_stealing_pool::run(task * t)
+{
+    t->fn();
+
+    /* The group may go as soon as it sees zero, so t goes first */
+    auto * g = t->owner;
+    delete t;
+
+    if (g)
+        g->m_pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+using task_group = work_stealing_pool::group;
+
+#endif  // WORK_STEALING_POOL_H